@@ -0,0 +1,273 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+// gc-bench: run every benchmark program with several input sizes and heap configurations
+// usage: gc-bench [--bin-dir <dir>] [--filter <name>] [--heap <size>]... [--repeat <n>] [--csv]
+//
+// Each run reads GC statistics exported by the program itself (STELLA_GC_STATS_FILE)
+// and peak RSS reported by the kernel for the child process.
+
+#define MAX_SIZES 4
+#define MAX_HEAPS 8
+#define STATS_LINE_SIZE 8192
+
+typedef struct benchmark_t {
+    const char *name;       // executable is bench-<name>
+    int sizes[MAX_SIZES];   // 0 terminated
+} benchmark_t;
+
+static const benchmark_t benchmarks[] = {
+    {"fibbonachi", {15, 20, 24}},
+    {"factorial", {6, 7, 8}},
+    {"exp2", {10, 14, 16}},
+    {"binary-trees", {10, 12, 14}},
+    {"cons-lists", {1000, 5000, 20000}},
+    {"ref-churn", {1000, 4000, 10000}},
+    {"deep-recursion", {100, 300, 600}},
+};
+
+static const char *default_heaps[] = {"1K", "1M", "16M"};
+
+typedef struct run_result_t {
+    double wall_ms;
+    long max_rss_kb;
+    uint64_t gc_ns;
+    uint64_t step_p50_ns;
+    uint64_t step_p99_ns;
+    uint64_t step_p999_ns;
+    uint64_t max_pause_ns;
+    uint64_t full_gcs;
+    uint64_t allocated_bytes;
+} run_result_t;
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// value of a column in the two-line CSV written by gc_export_stats
+static uint64_t csv_value(char *header, char *values, const char *name) {
+    char header_copy[STATS_LINE_SIZE], values_copy[STATS_LINE_SIZE];
+    snprintf(header_copy, sizeof(header_copy), "%s", header);
+    snprintf(values_copy, sizeof(values_copy), "%s", values);
+    char *header_state, *values_state;
+    char *column = strtok_r(header_copy, ",\n", &header_state);
+    char *value = strtok_r(values_copy, ",\n", &values_state);
+    while (column != NULL && value != NULL) {
+        if (strcmp(column, name) == 0) {
+            return strtoull(value, NULL, 10);
+        }
+        column = strtok_r(NULL, ",\n", &header_state);
+        value = strtok_r(NULL, ",\n", &values_state);
+    }
+    return 0;
+}
+
+static bool read_stats(const char *path, run_result_t *result) {
+    char header[STATS_LINE_SIZE], values[STATS_LINE_SIZE];
+    FILE *in = fopen(path, "r");
+    if (in == NULL) {
+        return false;
+    }
+    bool ok = fgets(header, sizeof(header), in) != NULL && fgets(values, sizeof(values), in) != NULL;
+    fclose(in);
+    if (!ok) {
+        return false;
+    }
+    result->gc_ns = csv_value(header, values, "total_gc_ns");
+    result->step_p50_ns = csv_value(header, values, "step_pause_p50_ns");
+    result->step_p99_ns = csv_value(header, values, "step_pause_p99_ns");
+    result->step_p999_ns = csv_value(header, values, "step_pause_p999_ns");
+    result->max_pause_ns = csv_value(header, values, "step_pause_max_ns");
+    const char *max_columns[] = {"full_pause_max_ns", "cleanup_pause_max_ns"};
+    for (int i = 0; i < 2; i++) {
+        uint64_t max_ns = csv_value(header, values, max_columns[i]);
+        if (max_ns > result->max_pause_ns) {
+            result->max_pause_ns = max_ns;
+        }
+    }
+    result->full_gcs = csv_value(header, values, "full_pauses");
+    result->allocated_bytes = csv_value(header, values, "total_allocated_bytes");
+    return true;
+}
+
+static bool run_once(const char *executable, int size, const char *heap, run_result_t *result) {
+    char stats_path[] = "/tmp/gc-bench-XXXXXX";
+    int stats_fd = mkstemp(stats_path);
+    if (stats_fd < 0) {
+        perror("mkstemp");
+        return false;
+    }
+    close(stats_fd);
+    int input[2];
+    if (pipe(input) != 0) {
+        perror("pipe");
+        unlink(stats_path);
+        return false;
+    }
+
+    double start_ms = now_ms();
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(input[0], STDIN_FILENO);
+        close(input[0]);
+        close(input[1]);
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+        setenv("STELLA_GC_STATS_FILE", stats_path, 1);
+        setenv("STELLA_GC_STATS_FORMAT", "csv", 1);
+        setenv("STELLA_GC_HEAP_SIZE", heap, 1);
+        execl(executable, executable, (char *) NULL);
+        perror(executable);
+        _exit(127);
+    }
+    close(input[0]);
+    if (pid < 0) {
+        perror("fork");
+        close(input[1]);
+        unlink(stats_path);
+        return false;
+    }
+    dprintf(input[1], "%d\n", size);
+    close(input[1]);
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        perror("wait4");
+        unlink(stats_path);
+        return false;
+    }
+    result->wall_ms = now_ms() - start_ms;
+    result->max_rss_kb = usage.ru_maxrss;
+
+    bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (!ok) {
+        if (WIFSIGNALED(status)) {
+            fprintf(stderr, "%s %d (heap %s): killed by signal %d\n", executable, size, heap, WTERMSIG(status));
+        } else {
+            fprintf(stderr, "%s %d (heap %s): exit status %d\n", executable, size, heap, WEXITSTATUS(status));
+        }
+    } else if (!read_stats(stats_path, result)) {
+        fprintf(stderr, "%s %d (heap %s): no GC statistics written\n", executable, size, heap);
+        ok = false;
+    }
+    unlink(stats_path);
+    return ok;
+}
+
+static void print_header(bool csv) {
+    if (csv) {
+        printf("benchmark,size,heap,wall_ms,gc_ms,gc_percent,step_p50_us,step_p99_us,step_p999_us,"
+               "max_pause_us,full_gcs,allocated_mb,max_rss_mb\n");
+        return;
+    }
+    printf("%-16s %7s %5s %10s %10s %6s %9s %9s %9s %10s %6s %10s %8s\n", "benchmark", "size", "heap", "wall ms",
+           "gc ms", "gc%", "p50 us", "p99 us", "p99.9 us", "max us", "full", "alloc MB", "rss MB");
+}
+
+static void print_result(bool csv, const char *name, int size, const char *heap, const run_result_t *result) {
+    double gc_ms = result->gc_ns / 1e6;
+    double gc_percent = result->wall_ms > 0 ? 100.0 * gc_ms / result->wall_ms : 0.0;
+    const char *format = csv ? "%s,%d,%s,%.2f,%.2f,%.1f,%.3f,%.3f,%.3f,%.1f,%lu,%.1f,%.1f\n"
+                             : "%-16s %7d %5s %10.2f %10.2f %5.1f%% %9.3f %9.3f %9.3f %10.1f %6lu %10.1f %8.1f\n";
+    printf(format, name, size, heap, result->wall_ms, gc_ms, gc_percent, result->step_p50_ns / 1e3,
+           result->step_p99_ns / 1e3, result->step_p999_ns / 1e3, result->max_pause_ns / 1e3,
+           (unsigned long) result->full_gcs, result->allocated_bytes / (1024.0 * 1024.0),
+           result->max_rss_kb / 1024.0);
+    fflush(stdout);
+}
+
+static void usage(const char *program) {
+    printf("usage: %s [--bin-dir <dir>] [--filter <name>] [--heap <size>]... [--repeat <n>] [--csv]\n", program);
+    printf("  --bin-dir  directory with bench-* executables (default: directory of %s)\n", program);
+    printf("  --filter   only run benchmarks whose name contains <name>\n");
+    printf("  --heap     initial heap size, e.g. 64K or 16M (default: 1K 1M 16M)\n");
+    printf("  --repeat   runs per configuration, the fastest one is reported (default: 1)\n");
+    printf("  --csv      machine readable output\n");
+}
+
+int main(int argc, char **argv) {
+    char bin_dir[4096];
+    const char *filter = NULL;
+    const char *heaps[MAX_HEAPS];
+    int heaps_count = 0;
+    int repeat = 1;
+    bool csv = false;
+
+    // by default benchmarks are built next to the driver
+    snprintf(bin_dir, sizeof(bin_dir), "%s", argv[0]);
+    char *slash = strrchr(bin_dir, '/');
+    if (slash != NULL) {
+        *slash = '\0';
+    } else {
+        snprintf(bin_dir, sizeof(bin_dir), ".");
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bin-dir") == 0 && i + 1 < argc) {
+            snprintf(bin_dir, sizeof(bin_dir), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--heap") == 0 && i + 1 < argc && heaps_count < MAX_HEAPS) {
+            heaps[heaps_count++] = argv[++i];
+        } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--csv") == 0) {
+            csv = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (heaps_count == 0) {
+        heaps_count = sizeof(default_heaps) / sizeof(default_heaps[0]);
+        memcpy(heaps, default_heaps, sizeof(default_heaps));
+    }
+    if (repeat < 1) {
+        repeat = 1;
+    }
+
+    int failures = 0;
+    print_header(csv);
+    for (size_t b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++) {
+        const benchmark_t *benchmark = &benchmarks[b];
+        if (filter != NULL && strstr(benchmark->name, filter) == NULL) {
+            continue;
+        }
+        char executable[4352];
+        snprintf(executable, sizeof(executable), "%s/bench-%s", bin_dir, benchmark->name);
+        if (access(executable, X_OK) != 0) {
+            fprintf(stderr, "%s not found, skipping\n", executable);
+            failures++;
+            continue;
+        }
+        for (int s = 0; s < MAX_SIZES && benchmark->sizes[s] != 0; s++) {
+            for (int h = 0; h < heaps_count; h++) {
+                run_result_t best = {0}, result;
+                bool ok = true;
+                for (int r = 0; r < repeat && ok; r++) {
+                    ok = run_once(executable, benchmark->sizes[s], heaps[h], &result);
+                    if (ok && (r == 0 || result.wall_ms < best.wall_ms)) {
+                        best = result;
+                    }
+                }
+                if (ok) {
+                    print_result(csv, benchmark->name, benchmark->sizes[s], heaps[h], &best);
+                } else {
+                    failures++;
+                }
+            }
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "runtime.h"
+#include "gc_internal.h"
+
+// gc-locality: mutator locality after a collection, for every copy order
+// usage: gc-locality [list length, default 200000] [repeats, default 10]
+//
+// Two lists of small Peano numbers and two long Peano numbers are built interleaved with each
+// other and with garbage, so that allocation order says nothing about traversal order. After a
+// full collection one list and one number are traversed. Reported per visited object: the best
+// traversal time, the mean distance to the previously visited object and last-level cache misses
+// (if perf events are available).
+
+#define GARBAGE_PER_CELL 2
+
+typedef struct traversal_t {
+    double ns_per_object;
+    double mean_gap;
+    double misses_per_object;   // negative if perf events are not available
+} traversal_t;
+
+static const char *const order_names[] = {"chase", "depth-first"};
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int open_cache_misses() {
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static void counter_start(int fd) {
+#ifdef __linux__
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+static long long counter_stop(int fd) {
+    long long value = -1;
+#ifdef __linux__
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &value, sizeof(value)) != sizeof(value)) {
+            value = -1;
+        }
+    }
+#endif
+    return value;
+}
+
+static stella_object *cons(stella_object *head, stella_object *tail) {
+    gc_push_root((void **) &head);
+    gc_push_root((void **) &tail);
+    stella_object *cell = alloc_stella_object(TAG_CONS, 2);
+    STELLA_OBJECT_INIT_FIELD(cell, 0, head);
+    STELLA_OBJECT_INIT_FIELD(cell, 1, tail);
+    gc_pop_root((void **) &tail);
+    gc_pop_root((void **) &head);
+    return cell;
+}
+
+static stella_object *succ(stella_object *n) {
+    gc_push_root((void **) &n);
+    stella_object *m = alloc_stella_object(TAG_SUCC, 1);
+    STELLA_OBJECT_INIT_FIELD(m, 0, n);
+    gc_pop_root((void **) &n);
+    return m;
+}
+
+static void garbage() {
+    for (int i = 0; i < GARBAGE_PER_CELL; i++) {
+        stella_object *tuple = alloc_stella_object(TAG_TUPLE, 2);
+        STELLA_OBJECT_INIT_FIELD(tuple, 0, &the_UNIT);
+        STELLA_OBJECT_INIT_FIELD(tuple, 1, &the_UNIT);
+    }
+}
+
+// distance from the previously visited object
+static uint64_t gap_to(uintptr_t *previous, void *object) {
+    uintptr_t here = (uintptr_t) object;
+    uint64_t gap = here > *previous ? here - *previous : *previous - here;
+    *previous = here;
+    return gap;
+}
+
+// sum of the list's elements, every cell and every succ is visited
+static long traverse_list(stella_object *list, int misses_fd, traversal_t *result, int repeats) {
+    long sum = 0, visited = 0;
+    uint64_t best = UINT64_MAX;
+    long long misses = -1;
+    for (int r = 0; r < repeats; r++) {
+        sum = 0;
+        visited = 0;
+        counter_start(misses_fd);
+        uint64_t start = now_ns();
+        for (stella_object *cell = list; STELLA_OBJECT_HEADER_TAG(cell->object_header) == TAG_CONS;
+             cell = STELLA_OBJECT_READ_FIELD(cell, 1)) {
+            stella_object *n = STELLA_OBJECT_READ_FIELD(cell, 0);
+            visited += 1;
+            while (STELLA_OBJECT_HEADER_TAG(n->object_header) == TAG_SUCC) {
+                n = STELLA_OBJECT_SUCC_ARG(n);
+                sum += 1;
+                visited += 1;
+            }
+        }
+        uint64_t ns = now_ns() - start;
+        long long run_misses = counter_stop(misses_fd);
+        if (ns < best) {
+            best = ns;
+            misses = run_misses;
+        }
+    }
+    // address gaps, in visiting order
+    uint64_t gaps = 0;
+    uintptr_t previous = (uintptr_t) list;
+    for (stella_object *cell = list; STELLA_OBJECT_HEADER_TAG(cell->object_header) == TAG_CONS;
+         cell = cell->object_fields[1]) {
+        gaps += gap_to(&previous, cell);
+        for (stella_object *n = cell->object_fields[0]; STELLA_OBJECT_HEADER_TAG(n->object_header) == TAG_SUCC;
+             n = n->object_fields[0]) {
+            gaps += gap_to(&previous, n);
+        }
+    }
+    result->ns_per_object = (double) best / visited;
+    result->mean_gap = (double) gaps / visited;
+    result->misses_per_object = misses >= 0 ? (double) misses / visited : -1.0;
+    return sum;
+}
+
+static long traverse_nat(stella_object *n, int misses_fd, traversal_t *result, int repeats) {
+    long length = 0;
+    uint64_t best = UINT64_MAX;
+    long long misses = -1;
+    for (int r = 0; r < repeats; r++) {
+        counter_start(misses_fd);
+        uint64_t start = now_ns();
+        length = stella_object_to_nat(n);
+        uint64_t ns = now_ns() - start;
+        long long run_misses = counter_stop(misses_fd);
+        if (ns < best) {
+            best = ns;
+            misses = run_misses;
+        }
+    }
+    uint64_t gaps = 0;
+    uintptr_t previous = (uintptr_t) n;
+    for (stella_object *m = n; STELLA_OBJECT_HEADER_TAG(m->object_header) == TAG_SUCC; m = m->object_fields[0]) {
+        gaps += gap_to(&previous, m);
+    }
+    const long visited = length > 0 ? length : 1;
+    result->ns_per_object = (double) best / visited;
+    result->mean_gap = (double) gaps / visited;
+    result->misses_per_object = misses >= 0 ? (double) misses / visited : -1.0;
+    return length;
+}
+
+static void print_row(const char *order, const char *structure, const traversal_t *t) {
+    char misses[32];
+    if (t->misses_per_object >= 0) {
+        snprintf(misses, sizeof(misses), "%.3f", t->misses_per_object);
+    } else {
+        snprintf(misses, sizeof(misses), "n/a");
+    }
+    printf("%-12s %-6s %12.2f %14.1f %14s\n", order, structure, t->ns_per_object, t->mean_gap, misses);
+}
+
+static void run(GC_COPY_ORDER order, long length, int repeats, int misses_fd) {
+    gc_context_t *context = gc_context_create();
+    gc_context_t *previous = gc_context_bind(context);
+    gc_set_copy_order(order);
+
+    stella_object *list = &the_EMPTY, *other = &the_EMPTY, *nat = &the_ZERO, *other_nat = &the_ZERO, *head = NULL;
+    gc_push_root((void **) &head);
+    gc_push_root((void **) &list);
+    gc_push_root((void **) &other);
+    gc_push_root((void **) &nat);
+    gc_push_root((void **) &other_nat);
+    for (long i = 0; i < length; i++) {
+        // the head is built first, a collection may move the list meanwhile
+        head = nat_to_stella_object(i % 8);
+        list = cons(head, list);
+        garbage();
+        head = nat_to_stella_object((i + 3) % 8);
+        other = cons(head, other);
+        nat = succ(nat);
+        other_nat = succ(other_nat);
+        garbage();
+    }
+    gc_full();
+
+    traversal_t list_result, nat_result;
+    long sum = traverse_list(list, misses_fd, &list_result, repeats);
+    long nat_length = traverse_nat(nat, misses_fd, &nat_result, repeats);
+    if (nat_length != length || sum != length / 8 * 28 + (length % 8) * (length % 8 - 1) / 2) {
+        printf("%s: wrong traversal result (%ld, %ld)\n", order_names[order], sum, nat_length);
+        exit(1);
+    }
+    print_row(order_names[order], "list", &list_result);
+    print_row(order_names[order], "nat", &nat_result);
+
+    gc_pop_root((void **) &other_nat);
+    gc_pop_root((void **) &nat);
+    gc_pop_root((void **) &other);
+    gc_pop_root((void **) &list);
+    gc_pop_root((void **) &head);
+    gc_context_bind(previous);
+    gc_context_destroy(context);
+}
+
+int main(int argc, char **argv) {
+    long length = argc > 1 ? atol(argv[1]) : 200000;
+    int repeats = argc > 2 ? atoi(argv[2]) : 10;
+    if (length <= 0 || repeats <= 0) {
+        printf("usage: %s [list length] [repeats]\n", argv[0]);
+        return 1;
+    }
+    int misses_fd = open_cache_misses();
+    if (misses_fd < 0) {
+        printf("perf events are not available, cache misses are not measured\n");
+    }
+    printf("%-12s %-6s %12s %14s %14s\n", "order", "data", "ns/object", "mean gap (B)", "misses/object");
+    run(GC_COPY_CHASE, length, repeats, misses_fd);
+    run(GC_COPY_DEPTH_FIRST, length, repeats, misses_fd);
+    if (misses_fd >= 0) {
+        close(misses_fd);
+    }
+    return 0;
+}
@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "runtime.h"
+#include "gc_internal.h"
+
+// gc-microbench: per-operation cost of the GC fast paths
+// usage: gc-microbench [ops per measurement, default 200000]
+//
+// The collector is driven to each phase (idle, marking, copying) with explicit steps
+// before measuring. Allocations are timed one by one, as each of them advances the
+// collector, barriers and root pushes are timed in loops.
+
+#define LIVE_ROOTS 64
+
+typedef enum BENCH_PHASE {
+    PHASE_IDLE,     // marking done, waiting for the heap to fill up
+    PHASE_MARKING,
+    PHASE_COPYING,
+    PHASE_COUNT,
+} BENCH_PHASE;
+
+static const char *const phase_names[PHASE_COUNT] = {"idle", "marking", "copying"};
+
+typedef struct bench_counter_t {
+    uint64_t ops;
+    uint64_t ns;
+    uint64_t cycles;
+} bench_counter_t;
+
+static stella_object *live[LIVE_ROOTS];
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t now_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// cost of reading both clocks, subtracted from individually timed operations
+static uint64_t timer_ns = 0, timer_cycles = 0;
+
+static void calibrate_timer() {
+    timer_ns = UINT64_MAX;
+    timer_cycles = UINT64_MAX;
+    for (int i = 0; i < 10000; i++) {
+        uint64_t start_ns = now_ns(), start_cycles = now_cycles();
+        uint64_t ns = now_ns() - start_ns, cycles = now_cycles() - start_cycles;
+        timer_ns = ns < timer_ns ? ns : timer_ns;
+        timer_cycles = cycles < timer_cycles ? cycles : timer_cycles;
+    }
+}
+
+static BENCH_PHASE current_phase() {
+    if (gc->phase == SWEEP) {
+        return PHASE_COPYING;
+    }
+    return is_empty(gc->grey_queue) ? PHASE_IDLE : PHASE_MARKING;
+}
+
+static stella_object *alloc_object(int fields_count) {
+    stella_object *object = alloc_stella_object(TAG_TUPLE, fields_count);
+    for (int i = 0; i < fields_count; i++) {
+        STELLA_OBJECT_INIT_FIELD(object, i, &the_UNIT);
+    }
+    return object;
+}
+
+// run collector steps (allocating only to fill the heap) until it is in the given phase,
+// false if it never gets there
+static bool drive_to_phase(BENCH_PHASE phase) {
+    for (long i = 0; i < 10000000; i++) {
+        BENCH_PHASE current = current_phase();
+        if (current == phase) {
+            return true;
+        }
+        if (current == PHASE_IDLE) {
+            // a new object is grey until it is scanned, copying starts once the heap is full enough
+            live[2 + i % (LIVE_ROOTS - 2)] = alloc_object(2);
+        } else {
+            gc_step();
+        }
+    }
+    return false;
+}
+
+static void print_header() {
+    printf("%-16s %6s %-8s %12s %10s %12s %12s\n", "operation", "fields", "phase", "ops", "ns/op", "cycles/op",
+           "Mops/s");
+}
+
+static void print_counter(const char *operation, int fields_count, const char *phase, const bench_counter_t *counter) {
+    if (counter->ops == 0) {
+        printf("%-16s %6d %-8s %12s\n", operation, fields_count, phase, "-");
+        return;
+    }
+    double ns_per_op = (double) counter->ns / counter->ops;
+    printf("%-16s %6d %-8s %12lu %10.2f %12.1f %12.2f\n", operation, fields_count, phase,
+           (unsigned long) counter->ops, ns_per_op, (double) counter->cycles / counter->ops,
+           ns_per_op > 0 ? 1e3 / ns_per_op : 0.0);
+}
+
+static void bench_alloc(long ops, int fields_count, BENCH_PHASE phase) {
+    bench_counter_t counter = {0};
+    for (long i = 0; i < ops; i++) {
+        if (current_phase() != phase && !drive_to_phase(phase)) {
+            break;
+        }
+        uint64_t start_ns = now_ns(), start_cycles = now_cycles();
+        stella_object *object = alloc_stella_object(TAG_TUPLE, fields_count);
+        uint64_t ns = now_ns() - start_ns, cycles = now_cycles() - start_cycles;
+        for (int j = 0; j < fields_count; j++) {
+            STELLA_OBJECT_INIT_FIELD(object, j, &the_UNIT);
+        }
+        // one object in eight survives for a while
+        if ((i & 7) == 0) {
+            live[2 + (i / 8) % (LIVE_ROOTS - 2)] = object;
+        }
+        counter.ops += 1;
+        counter.ns += ns > timer_ns ? ns - timer_ns : 0;
+        counter.cycles += cycles > timer_cycles ? cycles - timer_cycles : 0;
+    }
+    print_counter("gc_alloc", fields_count, phase_names[phase], &counter);
+}
+
+typedef enum BENCH_OPERATION {
+    OP_READ_BARRIER,
+    OP_WRITE_BARRIER,
+    OP_WRITE_STATIC,
+    OP_PUSH_POP_ROOT,
+    OP_COUNT,
+} BENCH_OPERATION;
+
+static const char *const operation_names[OP_COUNT] = {
+    "read_barrier", "write_barrier", "write_static", "push_pop_root",
+};
+
+static void bench_operation(long ops, BENCH_OPERATION operation, BENCH_PHASE phase) {
+    bench_counter_t counter = {0};
+    if (!drive_to_phase(phase)) {
+        print_counter(operation_names[operation], 2, phase_names[phase], &counter);
+        return;
+    }
+    stella_object *object = live[0], *contents = live[1], *local = &the_UNIT;
+    uint64_t start_ns = now_ns(), start_cycles = now_cycles();
+    switch (operation) {
+        case OP_READ_BARRIER:
+            for (long i = 0; i < ops; i++) {
+                local = STELLA_OBJECT_READ_FIELD(object, i & 1);
+            }
+            break;
+        case OP_WRITE_BARRIER:
+            for (long i = 0; i < ops; i++) {
+                STELLA_OBJECT_WRITE_FIELD(object, i & 1, contents);
+            }
+            break;
+        case OP_WRITE_STATIC:
+            for (long i = 0; i < ops; i++) {
+                STELLA_OBJECT_WRITE_FIELD(object, i & 1, &the_UNIT);
+            }
+            break;
+        case OP_PUSH_POP_ROOT:
+            for (long i = 0; i < ops; i++) {
+                gc_push_root((void **) &local);
+                gc_pop_root((void **) &local);
+            }
+            break;
+        case OP_COUNT:
+            break;
+    }
+    counter.ops = ops;
+    counter.ns = now_ns() - start_ns;
+    counter.cycles = now_cycles() - start_cycles;
+    // keep the loops from being optimised away
+    live[LIVE_ROOTS - 1] = local;
+    print_counter(operation_names[operation], 2, phase_names[phase], &counter);
+}
+
+int main(int argc, char **argv) {
+    long ops = argc > 1 ? atol(argv[1]) : 200000;
+    if (ops < 1) {
+        ops = 1;
+    }
+    for (int i = 0; i < LIVE_ROOTS; i++) {
+        live[i] = &the_UNIT;
+        gc_push_root((void **) &live[i]);
+    }
+    live[0] = alloc_object(2);
+    live[1] = alloc_object(2);
+
+    calibrate_timer();
+    print_header();
+    const int sizes[] = {1, 2, 4, 8, 15};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        for (int phase = 0; phase < PHASE_COUNT; phase++) {
+            bench_alloc(ops, sizes[i], phase);
+        }
+    }
+    for (int operation = 0; operation < OP_COUNT; operation++) {
+        for (int phase = 0; phase < PHASE_COUNT; phase++) {
+            bench_operation(ops, operation, phase);
+        }
+    }
+#if !defined(__x86_64__) && !defined(__i386__)
+    printf("(no cycle counter on this architecture)\n");
+#endif
+
+    for (int i = LIVE_ROOTS - 1; i >= 0; i--) {
+        gc_pop_root((void **) &live[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include <stdio.h>
+
+#include "runtime.h"
+
+// GCBench-style workload: a long-lived tree and an array-like list of long-lived
+// nodes stay reachable while many short-lived trees of growing depth are built.
+// Tree nodes are pairs {left, right}, leaves are the empty tuple.
+// input: maximum tree depth
+
+static stella_object *make_tree(int depth) {
+    stella_object *left = &the_EMPTY_TUPLE, *right = &the_EMPTY_TUPLE, *node;
+    if (depth == 0) {
+        return &the_EMPTY_TUPLE;
+    }
+    gc_push_root((void **) &left);
+    gc_push_root((void **) &right);
+    left = make_tree(depth - 1);
+    right = make_tree(depth - 1);
+    node = alloc_stella_object(TAG_TUPLE, 2);
+    STELLA_OBJECT_INIT_FIELD(node, 0, left);
+    STELLA_OBJECT_INIT_FIELD(node, 1, right);
+    gc_pop_root((void **) &right);
+    gc_pop_root((void **) &left);
+    return node;
+}
+
+static int check_tree(stella_object *node) {
+    if (STELLA_OBJECT_HEADER_FIELD_COUNT(node->object_header) == 0) {
+        return 1;
+    }
+    return 1 + check_tree(STELLA_OBJECT_READ_FIELD(node, 0)) + check_tree(STELLA_OBJECT_READ_FIELD(node, 1));
+}
+
+int main(int argc, char **argv) {
+    int max_depth = 0;
+    if (scanf("%d", &max_depth) != 1 || max_depth < 4) {
+        max_depth = 4;
+    }
+    stella_object *long_lived = &the_EMPTY_TUPLE, *temp = &the_EMPTY_TUPLE;
+    gc_push_root((void **) &long_lived);
+    gc_push_root((void **) &temp);
+
+    long_lived = make_tree(max_depth - 2);
+    long check = 0;
+    for (int depth = 4; depth <= max_depth; depth += 2) {
+        int iterations = 1 << (max_depth - depth + 4);
+        for (int i = 0; i < iterations; i++) {
+            temp = make_tree(depth);
+            check += check_tree(temp);
+        }
+        printf("%d trees of depth %d, check %ld\n", iterations, depth, check);
+    }
+    printf("long lived tree of depth %d, check %d\n", max_depth - 2, check_tree(long_lived));
+
+    gc_pop_root((void **) &temp);
+    gc_pop_root((void **) &long_lived);
+    print_gc_alloc_stats();
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <stdio.h>
+
+#include "runtime.h"
+
+// Long-lived cons lists: a list of n naturals is kept alive while it is
+// repeatedly mapped into fresh lists (succ of every element) and reversed,
+// the previous generation becomes garbage.
+// input: list length
+
+static stella_object *cons(stella_object *head, stella_object *tail) {
+    stella_object *cell;
+    gc_push_root((void **) &head);
+    gc_push_root((void **) &tail);
+    cell = alloc_stella_object(TAG_CONS, 2);
+    STELLA_OBJECT_INIT_FIELD(cell, 0, head);
+    STELLA_OBJECT_INIT_FIELD(cell, 1, tail);
+    gc_pop_root((void **) &tail);
+    gc_pop_root((void **) &head);
+    return cell;
+}
+
+// reverse(map(succ, list))
+static stella_object *succ_all(stella_object *list) {
+    stella_object *result = &the_EMPTY, *head = &the_EMPTY;
+    gc_push_root((void **) &list);
+    gc_push_root((void **) &result);
+    gc_push_root((void **) &head);
+    while (STELLA_OBJECT_HEADER_TAG(list->object_header) == TAG_CONS) {
+        head = alloc_stella_object(TAG_SUCC, 1);
+        STELLA_OBJECT_INIT_FIELD(head, 0, STELLA_OBJECT_READ_FIELD(list, 0));
+        result = cons(head, result);
+        list = STELLA_OBJECT_READ_FIELD(list, 1);
+    }
+    gc_pop_root((void **) &head);
+    gc_pop_root((void **) &result);
+    gc_pop_root((void **) &list);
+    return result;
+}
+
+static long sum(stella_object *list) {
+    long result = 0;
+    while (STELLA_OBJECT_HEADER_TAG(list->object_header) == TAG_CONS) {
+        result += stella_object_to_nat(STELLA_OBJECT_READ_FIELD(list, 0));
+        list = STELLA_OBJECT_READ_FIELD(list, 1);
+    }
+    return result;
+}
+
+int main(int argc, char **argv) {
+    int n = 0;
+    if (scanf("%d", &n) != 1 || n < 1) {
+        n = 1;
+    }
+    stella_object *list = &the_EMPTY;
+    gc_push_root((void **) &list);
+    for (int i = 0; i < n; i++) {
+        list = cons(&the_ZERO, list);
+    }
+    for (int generation = 0; generation < 64; generation++) {
+        list = succ_all(list);
+    }
+    printf("sum = %ld\n", sum(list));
+    gc_pop_root((void **) &list);
+    print_gc_alloc_stats();
+    return 0;
+}
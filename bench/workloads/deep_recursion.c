@@ -0,0 +1,57 @@
+#include <stdio.h>
+
+#include "runtime.h"
+
+// Deep recursion: every frame keeps its own roots alive (as generated code does)
+// while allocating on the way down and on the way back up, so the root stack is
+// deep at every collection.
+// input: recursion depth (at most a few hundred frames fit the root stack)
+
+static stella_object *descend(int depth, stella_object *acc) {
+    stella_object *local = &the_ZERO, *result = &the_ZERO;
+    gc_push_root((void **) &acc);
+    gc_push_root((void **) &local);
+    gc_push_root((void **) &result);
+    local = alloc_stella_object(TAG_INL, 1);
+    STELLA_OBJECT_INIT_FIELD(local, 0, acc);
+    if (depth == 0) {
+        result = local;
+    } else {
+        result = descend(depth - 1, local);
+    }
+    local = alloc_stella_object(TAG_INR, 1);
+    STELLA_OBJECT_INIT_FIELD(local, 0, result);
+    // keep the chain built on the way down, drop the wrapper
+    result = STELLA_OBJECT_READ_FIELD(local, 0);
+    gc_pop_root((void **) &result);
+    gc_pop_root((void **) &local);
+    gc_pop_root((void **) &acc);
+    return result;
+}
+
+static int chain_length(stella_object *obj) {
+    int length = 0;
+    while (STELLA_OBJECT_HEADER_TAG(obj->object_header) == TAG_INL) {
+        obj = STELLA_OBJECT_READ_FIELD(obj, 0);
+        length++;
+    }
+    return length;
+}
+
+int main(int argc, char **argv) {
+    int depth = 0;
+    if (scanf("%d", &depth) != 1 || depth < 1) {
+        depth = 1;
+    }
+    stella_object *chain = &the_ZERO;
+    gc_push_root((void **) &chain);
+    long total = 0;
+    for (int i = 0; i < 2000; i++) {
+        chain = descend(depth, &the_ZERO);
+        total += chain_length(chain);
+    }
+    printf("total = %ld (expected %ld)\n", total, 2000L * (depth + 1));
+    gc_pop_root((void **) &chain);
+    print_gc_alloc_stats();
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include <stdio.h>
+
+#include "runtime.h"
+
+// Ref mutation churn: a table of n references (a cons list of refs) is updated
+// in rounds, every write stores a freshly allocated value through the write
+// barrier, and old values die young.
+// input: number of references
+
+int main(int argc, char **argv) {
+    int n = 0;
+    if (scanf("%d", &n) != 1 || n < 1) {
+        n = 1;
+    }
+    stella_object *refs = &the_EMPTY, *cell = &the_EMPTY, *value = &the_ZERO;
+    gc_push_root((void **) &refs);
+    gc_push_root((void **) &cell);
+    gc_push_root((void **) &value);
+    for (int i = 0; i < n; i++) {
+        value = alloc_stella_object(TAG_REF, 1);
+        STELLA_OBJECT_INIT_FIELD(value, 0, &the_ZERO);
+        cell = alloc_stella_object(TAG_CONS, 2);
+        STELLA_OBJECT_INIT_FIELD(cell, 0, value);
+        STELLA_OBJECT_INIT_FIELD(cell, 1, refs);
+        refs = cell;
+    }
+    const int rounds = 200;
+    for (int round = 0; round < rounds; round++) {
+        for (cell = refs; STELLA_OBJECT_HEADER_TAG(cell->object_header) == TAG_CONS;
+             cell = STELLA_OBJECT_READ_FIELD(cell, 1)) {
+            // ref := {succ(!ref), unit}, keeping only the counter
+            value = alloc_stella_object(TAG_SUCC, 1);
+            STELLA_OBJECT_INIT_FIELD(value, 0, STELLA_OBJECT_READ_FIELD(STELLA_OBJECT_READ_FIELD(cell, 0), 0));
+            stella_object *ref = STELLA_OBJECT_READ_FIELD(cell, 0);
+            STELLA_OBJECT_WRITE_FIELD(ref, 0, value);
+            value = alloc_stella_object(TAG_TUPLE, 2);
+            STELLA_OBJECT_INIT_FIELD(value, 0, &the_UNIT);
+            STELLA_OBJECT_INIT_FIELD(value, 1, &the_UNIT);
+        }
+    }
+    long total = 0;
+    for (cell = refs; STELLA_OBJECT_HEADER_TAG(cell->object_header) == TAG_CONS;
+         cell = STELLA_OBJECT_READ_FIELD(cell, 1)) {
+        total += stella_object_to_nat(STELLA_OBJECT_READ_FIELD(STELLA_OBJECT_READ_FIELD(cell, 0), 0));
+    }
+    printf("total = %ld (expected %ld)\n", total, (long) n * rounds);
+    gc_pop_root((void **) &value);
+    gc_pop_root((void **) &cell);
+    gc_pop_root((void **) &refs);
+    print_gc_alloc_stats();
+    return 0;
+}
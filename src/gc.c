@@ -3,173 +3,257 @@
 #include <stdbool.h>
 #include <math.h>
 #include <assert.h>
+#include <string.h>
+#include <stdatomic.h>
 
 #include "runtime.h"
 #include "gc.h"
+#include "gc_internal.h"
 #include "queue.h"
+#include "gc_trace.h"
+#include "gc_pause.h"
+#include "gc_shm.h"
+#include "gc_profile.h"
+#include "gc_weak.h"
+#include "gc_sample.h"
+#include "gc_record.h"
+#include "gc_context.h"
+#include "gc_intern.h"
+#include "gc_pretenure.h"
+
+_Thread_local gc_t *gc = NULL; // Garbage collector instance bound to this thread
+static gc_t *_Atomic env_context = NULL; // configured from the environment
+
+bool gc_init_sweep_helper(size_t size_in_bytes) {
+    void *new_heap = alloc_heap(size_in_bytes);
+    if (new_heap == NULL) {
+        return false;
+    }
+    gc->sweep_helper.next_heap = new_heap;
+    gc->sweep_helper.next_heap_size = size_in_bytes;
+    gc->sweep_helper.next = new_heap;
+    gc->sweep_helper.sweep_allocated_bytes = 0;
+    gc->sweep_helper.sweep_allocated_objects = 0;
+    return true;
+}
 
-#define MAX_GC_ROOTS 2048
-#define START_HEAP_SIZE 1024
-// enables a lot of debug output during gc work
-// #define STELLA_DEBUG
-
-typedef enum COLOR {
-    WHITE,
-    GREY,
-    BLACK,
-} COLOR;
-
-typedef enum GC_PHASE {
-    MARK,
-    SWEEP,
-} GC_PHASE;
-
-typedef struct gc_object_t {
-    COLOR color;
-    struct gc_object_t *moved_to;
-    stella_object obj;
-} gc_object_t;
-
-typedef struct gc_stats_t {
-    unsigned long total_allocated_bytes;
-    unsigned long total_allocated_objects;
-
-    unsigned long max_allocated_bytes;
-    unsigned long max_allocated_objects;
-
-    unsigned long current_allocated_bytes;
-    unsigned long current_allocated_objects;
-
-    unsigned long total_reads;
-    unsigned long total_writes;
-
-    unsigned long gc_roots_max_size;
-
-    unsigned long mark_steps;
-    unsigned long sweep_steps;
-    unsigned long sweep_phase_count;
-    unsigned long mark_phase_count;
-    unsigned long marked_objects;
-} gc_stats_t;
-
-typedef struct gc_sweep_helper_t {
-    void *next_heap;
-    size_t next_heap_size;
-    int sweep_allocated_bytes;
-    int sweep_allocated_objects;
-    void *next;
-} gc_sweep_helper_t;
-
-
-typedef struct gc_t {
-    // roots info
-    stella_object **roots[MAX_GC_ROOTS];
-    int roots_cont;
-
-    // in what phase GC now
-    GC_PHASE phase;
-
-    // queue for mark phase
-    queue_t *grey_queue;
-
-    // queue for sweep phase
-    queue_t *black_queue;
-
-    // garbage collector statistic
-    gc_stats_t stats;
-
-    // where to store current objects and where to move them in sweep phase
-    void *current_heap;
-    void *next_place_in_heap;
-    size_t current_heap_size;
-
-    gc_sweep_helper_t sweep_helper;
-} gc_t;
-
-void *alloc_heap(size_t size);
-
-void gc_init();
-
-bool is_enough_place_in_current_heap(size_t size_in_bytes);
-
-void *try_alloc(size_t size_in_bytes);
-
-bool mark_step();
-
-void gc_step();
-
-void gc_full();
-
-void mark_roots();
-
-void make_stella_object_grey_if_needed(stella_object *stella_obj);
-
-static bool is_in_current_heap(void *ptr);
-
-static bool is_in_next_heap(void *ptr);
-
-void sweep_cleanup();
-
-void sweep_chase(gc_object_t *old_gc_obj);
+void gc_init_stats(gc_stats_t *stats) {
+    memset(stats, 0, sizeof(gc_stats_t));
+}
 
-void *sweep_forward(stella_object *stella_obj);
+// <bytes>[K|M|G]
+static unsigned long long parse_size(const char *value) {
+    char *end;
+    unsigned long long size = strtoull(value, &end, 10);
+    switch (*end) {
+        case 'G': case 'g': size <<= 10; // fall through
+        case 'M': case 'm': size <<= 10; // fall through
+        case 'K': case 'k': size <<= 10; break;
+        default: break;
+    }
+    return size;
+}
 
-void gc_update_stats_after_object_alloc(size_t size_in_bytes);
+// STELLA_GC_HEAP_SIZE=<bytes>[K|M|G] sets the initial (and minimal) heap size
+static size_t gc_heap_size_from_env() {
+    const char *value = getenv("STELLA_GC_HEAP_SIZE");
+    if (value == NULL || *value == '\0') {
+        return START_HEAP_SIZE;
+    }
+    unsigned long long size = parse_size(value);
+    if (size < START_HEAP_SIZE) {
+        printf("STELLA_GC_HEAP_SIZE=%s is too small, using %d bytes\n", value, START_HEAP_SIZE);
+        return START_HEAP_SIZE;
+    }
+    if (size > GC_MAX_HEAP_SIZE) {
+        printf("STELLA_GC_HEAP_SIZE=%s is too large, using %lu bytes\n", value, (unsigned long) GC_MAX_HEAP_SIZE);
+        return GC_MAX_HEAP_SIZE;
+    }
+    return size;
+}
 
-bool is_enough_place_in_next_heap(size_t size_in_bytes);
+// STELLA_GC_SOFT_HEAP_LIMIT, STELLA_GC_HEAP_LIMIT=<bytes>[K|M|G], no limit if unset
+static size_t gc_heap_limit_from_env(const char *name) {
+    const char *value = getenv(name);
+    if (value == NULL || *value == '\0') {
+        return 0;
+    }
+    unsigned long long limit = parse_size(value);
+    if (limit > GC_MAX_HEAP_SIZE) {
+        printf("%s=%s is over the largest heap, using %lu bytes\n", name, value, (unsigned long) GC_MAX_HEAP_SIZE);
+        return GC_MAX_HEAP_SIZE;
+    }
+    return limit;
+}
 
-void *try_alloc_in_next(size_t size_in_bytes);
+// STELLA_GC_COPY_ORDER=chase|depth-first
+static GC_COPY_ORDER gc_copy_order_from_env() {
+    const char *value = getenv("STELLA_GC_COPY_ORDER");
+    if (value == NULL || *value == '\0' || strcmp(value, "chase") == 0) {
+        return GC_COPY_CHASE;
+    }
+    if (strcmp(value, "depth-first") == 0) {
+        return GC_COPY_DEPTH_FIRST;
+    }
+    printf("STELLA_GC_COPY_ORDER=%s is unknown, using chase\n", value);
+    return GC_COPY_CHASE;
+}
 
-void has_ill_fields_rec(gc_object_t *object);
+gc_context_t *gc_context_create() {
+    gc_t *context = malloc(sizeof(gc_t));
+    if (context == NULL) {
+        printf("Memory allocation for GC context failed!\n");
+        exit(1);
+    }
 
-void gc_init_sweep_helper(size_t size_in_bytes);
+    gc_init_stats(&context->stats);
+    gc_pause_tracker_init(&context->pauses);
+    gc_tag_profile_init(&context->tags);
+    context->weak_maps_count = 0;
+    gc_sampler_init(&context->sampler);
+
+    gc_mutator_init(&context->primary, context);
+    context->mutators = &context->primary;
+    context->mutators_count = 1;
+    // the primary mutator runs once the context is bound to a thread
+    context->mutators_parked = 1;
+    context->shared = false;
+    pthread_mutex_init(&context->lock, NULL);
+    pthread_cond_init(&context->parked_cond, NULL);
+    pthread_cond_init(&context->resume_cond, NULL);
+    atomic_init(&context->safepoint_requested, false);
+    context->pending_root_stacks = NULL;
+    context->scanned_root_stacks = NULL;
+
+    context->phase = MARK;
+
+    context->grey_queue = create_queue();
+    context->black_queue = create_queue();
+    context->copy_order = gc_copy_order_from_env();
+    context->copy_stack = NULL;
+    context->copy_stack_count = 0;
+    context->copy_stack_capacity = 0;
+    memset(&context->mark_prefetch, 0, sizeof(gc_prefetch_ring_t));
+    memset(&context->copy_prefetch, 0, sizeof(gc_prefetch_ring_t));
+
+    context->min_heap_size = gc_heap_size_from_env();
+    context->soft_heap_limit = gc_heap_limit_from_env("STELLA_GC_SOFT_HEAP_LIMIT");
+    context->hard_heap_limit = gc_heap_limit_from_env("STELLA_GC_HEAP_LIMIT");
+    if (context->hard_heap_limit != 0 && context->soft_heap_limit > context->hard_heap_limit) {
+        printf("STELLA_GC_SOFT_HEAP_LIMIT is over STELLA_GC_HEAP_LIMIT, ignoring it\n");
+        context->soft_heap_limit = 0;
+    }
+    context->oom_handler = NULL;
+    context->oom_data = NULL;
+    context->current_heap = alloc_heap(context->min_heap_size);
+    if (context->current_heap == NULL) {
+        printf("Memory allocation for new heap failed!\n");
+        exit(1);
+    }
+    context->current_heap_size = context->min_heap_size;
+    context->next_place_in_heap = context->current_heap;
+    context->marked_bytes = 0;
+    context->sweep_helper.next_heap = NULL;
+    context->sweep_helper.next_heap_size = 0;
+    context->sweep_helper.allocated = create_queue();
+    context->shm = NULL;
+    context->images_count = 0;
+    context->remembered = NULL;
+    context->remembered_count = 0;
+    context->remembered_capacity = 0;
+    gc_intern_table_init(&context->intern);
+    context->sites = NULL;
+    context->pretenure_threshold = 0;
+    memset(&context->mature, 0, sizeof(gc_mature_space_t));
+    GC_TRACE(GC_TRACE_MARK_PHASE, GC_TRACE_BEGIN, 0);
+    return context;
+}
 
-gc_object_t *stella_object_to_gc_object(void *ptr);
+static void free_queue(queue_t *queue) {
+    while (!is_empty(queue)) {
+        get(queue);
+    }
+    free(queue);
+}
 
-size_t get_gc_object_size(gc_object_t *obj);
+void gc_context_destroy(gc_context_t *context) {
+    if (context == NULL) {
+        return;
+    }
+    gc_t *previous = gc;
+    gc_mutator_t *previous_mutator = gc_mutator;
+    gc = context;
+    gc_shm_close();
+    if (gc->phase == SWEEP) {
+        free(gc->sweep_helper.next_heap);
+    }
+    free(gc->current_heap);
+    free_queue(gc->grey_queue);
+    free_queue(gc->black_queue);
+    free(gc->copy_stack);
+    free_queue(gc->sweep_helper.allocated);
+    gc_pause_tracker_free(&gc->pauses);
+    gc_sampler_free(&gc->sampler);
+    gc_images_free();
+    gc_intern_table_free(&gc->intern);
+    gc_pretenure_free();
+    // attached threads must have detached already
+    gc_mutator_t *mutator = gc->mutators;
+    while (mutator != NULL) {
+        gc_mutator_t *next = mutator->next;
+        gc_mutator_free(mutator);
+        if (mutator != &gc->primary) {
+            free(mutator);
+        }
+        mutator = next;
+    }
+    pthread_mutex_destroy(&gc->lock);
+    pthread_cond_destroy(&gc->parked_cond);
+    pthread_cond_destroy(&gc->resume_cond);
+    gc_t *expected = context;
+    atomic_compare_exchange_strong(&env_context, &expected, NULL);
+    free(context);
+    gc = previous == context ? NULL : previous;
+    gc_mutator = previous == context ? NULL : previous_mutator;
+}
 
-gc_t *gc = NULL; // Garbage collector instance
+gc_context_t *gc_context_bind(gc_context_t *context) {
+    gc_t *previous = gc;
+    // the thread's mutator of the previous context no longer runs
+    gc_blocking_begin();
+    gc = context;
+    gc_mutator = context == NULL ? NULL : &context->primary;
+    gc_blocking_end();
+    return previous;
+}
 
-void gc_init_sweep_helper(size_t size_in_bytes) {
-    void *new_heap = alloc_heap(size_in_bytes);
-    gc->sweep_helper.next_heap = new_heap;
-    gc->sweep_helper.next_heap_size = size_in_bytes;
-    gc->sweep_helper.next = new_heap;
-    gc->sweep_helper.sweep_allocated_bytes = 0;
-    gc->sweep_helper.sweep_allocated_objects = 0;
+gc_context_t *gc_context_current() {
+    return gc;
 }
 
-void gc_init_stats(gc_stats_t *stats) {
-    stats->current_allocated_bytes = 0;
-    stats->current_allocated_objects = 0;
-    stats->max_allocated_bytes = 0;
-    stats->max_allocated_objects = 0;
-    stats->total_allocated_bytes = 0;
-    stats->total_allocated_objects = 0;
-    stats->total_reads = 0;
-    stats->total_writes = 0;
-    stats->gc_roots_max_size = 0;
+// at-exit writers (stats, profiles) report on the context configured from the environment
+static void bind_env_context_at_exit() {
+    gc = atomic_load(&env_context);
 }
 
 void gc_init() {
     if (gc != NULL) {
         return;
     }
-    gc = malloc(sizeof(gc_t));
-
-    gc_init_stats(&gc->stats);
-
-    // gc->roots already allocated
-    gc->roots_cont = 0;
-
-    gc->phase = MARK;
-
-    gc->grey_queue = create_queue();
-    gc->black_queue = create_queue();
-
-    gc->current_heap = alloc_heap(START_HEAP_SIZE);
-    gc->current_heap_size = START_HEAP_SIZE;
-    gc->next_place_in_heap = gc->current_heap;
+    gc_context_bind(gc_context_create());
+    // environment settings apply to the first context of the process only
+    static atomic_flag env_configured = ATOMIC_FLAG_INIT;
+    if (!atomic_flag_test_and_set(&env_configured)) {
+        env_context = gc;
+        gc_trace_configure_from_env();
+        gc_stats_configure_from_env();
+        gc_shm_configure_from_env();
+        gc_sampler_configure_from_env();
+        gc_record_configure_from_env();
+        gc_intern_configure_from_env();
+        gc_pretenure_configure_from_env();
+        atexit(bind_env_context_at_exit);
+    }
 }
 
 bool is_enough_place_in_current_heap(size_t size_in_bytes) {
@@ -185,6 +269,24 @@ void *try_alloc(size_t size_in_bytes) {
     return NULL;
 }
 
+// while copying, new objects go straight to to-space so that the sweep does not have to chase them
+void *try_alloc_object(size_t size_in_bytes) {
+    if (gc->phase == SWEEP) {
+        // room for copying the rest of the live data is kept, so that the copy always fits
+        const size_t available = gc->sweep_helper.next_heap + gc->sweep_helper.next_heap_size - gc->sweep_helper.next;
+        if (size_in_bytes + gc_bytes_to_copy() > available) {
+            return NULL;
+        }
+        return try_alloc_in_next(size_in_bytes);
+    }
+    return try_alloc(size_in_bytes);
+}
+
+size_t gc_bytes_to_copy() {
+    return gc->marked_bytes > gc->sweep_helper.sweep_allocated_bytes
+               ? gc->marked_bytes - gc->sweep_helper.sweep_allocated_bytes : 0;
+}
+
 bool is_enough_place_in_next_heap(size_t size_in_bytes) {
     return gc->sweep_helper.next + size_in_bytes < gc->sweep_helper.next_heap + gc->sweep_helper.next_heap_size;
 }
@@ -199,120 +301,472 @@ void *try_alloc_in_next(size_t size_in_bytes) {
 }
 
 void gc_update_stats_after_object_alloc(size_t size_in_bytes) {
-    gc->stats.total_allocated_bytes += size_in_bytes;
-    gc->stats.total_allocated_objects += 1;
-    gc->stats.current_allocated_bytes += size_in_bytes;
-    gc->stats.current_allocated_objects += 1;
-    if (gc->stats.max_allocated_bytes < gc->stats.total_allocated_bytes) {
-        gc->stats.max_allocated_bytes = gc->stats.total_allocated_bytes;
+    gc_mutator->stats.allocated_bytes += size_in_bytes;
+    gc_mutator->stats.allocated_objects += 1;
+    gc_mutator->stats.current_allocated_bytes += size_in_bytes;
+    gc_mutator->stats.current_allocated_objects += 1;
+}
+
+void gc_update_stats_after_flip() {
+    gc->stats.last_residency_bytes = gc->sweep_helper.sweep_allocated_bytes;
+    gc->stats.last_residency_objects = gc->sweep_helper.sweep_allocated_objects;
+    if (gc->stats.max_residency_bytes < gc->stats.last_residency_bytes) {
+        gc->stats.max_residency_bytes = gc->stats.last_residency_bytes;
     }
-    if (gc->stats.max_allocated_objects < gc->stats.total_allocated_objects) {
-        gc->stats.max_allocated_objects = gc->stats.total_allocated_objects;
+    if (gc->stats.max_residency_objects < gc->stats.last_residency_objects) {
+        gc->stats.max_residency_objects = gc->stats.last_residency_objects;
     }
 }
 
 void *gc_alloc(size_t size_in_bytes_for_stella) {
+    return gc_alloc_at_site(size_in_bytes_for_stella, 0);
+}
+
+void *gc_alloc_at_site(size_t size_in_bytes_for_stella, int site) {
     // printf("stella object size = %d\n, p", sizeof(stella_object), (void *)NULL + (size_t)4);
     // printf("gc object size = %d\n", sizeof(gc_object_t));
+    gc_init();
+    gc_safepoint_poll();
+    if (site < 0 || site >= GC_MAX_SITES) {
+        printf("Invalid allocation site %d\n", site);
+        exit(1);
+    }
     size_t bytes_to_alloc = sizeof(gc_object_t) - sizeof(stella_object) + size_in_bytes_for_stella;
-    gc_object_t *ptr = try_alloc(bytes_to_alloc);
-    while (ptr == NULL) {
-        gc_full();
+    if (!gc_is_shared()) {
+        // collector work goes first, so the new object is only scanned after the mutator has initialised it;
+        // one step for the mature space and the heap alike
+        gc_step();
+    }
+    // site 0 is never pretenured
+    if (gc->sites != NULL && gc->sites[site].stats.pretenured) {
+        gc_object_t *ptr = gc_alloc_mature(bytes_to_alloc, site);
+        if (ptr != NULL) {
+            return &ptr->obj;
+        }
+    }
+    if (gc_is_shared()) {
+        // greyed (or queued for forwarding) at the next safepoint
+        bytes_to_alloc = (bytes_to_alloc + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *);
+        gc_object_t *ptr = gc_tlab_alloc(bytes_to_alloc);
+        gc_update_stats_after_object_alloc(bytes_to_alloc);
+        ptr->color = WHITE;
+        ptr->age = 0;
+        ptr->flags = 0;
+        ptr->site = site;
+        ptr->forward = 0;
+        return &ptr->obj;
+    }
+    gc_object_t *ptr = try_alloc_object(bytes_to_alloc);
+    for (int attempt = 0; ptr == NULL; attempt++) {
+        const bool can_retry = gc_collect_for(attempt);
         fflush(stdout);
-        ptr = try_alloc(bytes_to_alloc);
+        ptr = try_alloc_object(bytes_to_alloc);
+        if (ptr == NULL && !can_retry) {
+            gc_out_of_memory(bytes_to_alloc);
+        }
     }
     gc_update_stats_after_object_alloc(bytes_to_alloc);
+    gc_site_alloc(site, bytes_to_alloc, false);
 #ifdef STELLA_DEBUG
     printf("For %p allocated %lu \n", ptr, bytes_to_alloc);
 #endif
     ptr->color = WHITE;
-    ptr->moved_to = NULL;
+    ptr->age = 0;
+    ptr->flags = 0;
+    ptr->site = site;
+    ptr->forward = 0;
     // STELLA_OBJECT_INIT_FIELDS_COUNT((&ptr->obj), 0);
-    make_stella_object_grey_if_needed(&ptr->obj);
-    gc_step();
+    if (gc->phase == MARK) {
+        make_stella_object_grey_if_needed(&ptr->obj);
+    } else {
+        push(gc->sweep_helper.allocated, ptr);
+    }
     return &ptr->obj;
 }
 
+size_t gc_bulk_stride(size_t size_in_bytes_for_stella) {
+    const size_t size = sizeof(gc_object_t) - sizeof(stella_object) + size_in_bytes_for_stella;
+    return (size + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *);
+}
+
+void *gc_alloc_bulk(size_t size_in_bytes_for_stella, int count, int site) {
+    if (count <= 0) {
+        return NULL;
+    }
+    gc_init();
+    gc_safepoint_poll();
+    if (site < 0 || site >= GC_MAX_SITES) {
+        printf("Invalid allocation site %d\n", site);
+        exit(1);
+    }
+    const size_t stride = gc_bulk_stride(size_in_bytes_for_stella);
+    const size_t bytes_to_alloc = stride * count;
+    void *start;
+    if (gc_is_shared()) {
+        // an oversized request gets a TLAB of its own, objects are greyed when it is flushed
+        start = gc_tlab_alloc(bytes_to_alloc);
+    } else {
+        gc_step();
+        start = try_alloc_object(bytes_to_alloc);
+        for (int attempt = 0; start == NULL; attempt++) {
+            const bool can_retry = gc_collect_for(attempt);
+            fflush(stdout);
+            start = try_alloc_object(bytes_to_alloc);
+            if (start == NULL && !can_retry) {
+                gc_out_of_memory(bytes_to_alloc);
+            }
+        }
+    }
+    const int fields_count = (stride - sizeof(gc_object_t)) / sizeof(void *);
+    for (int i = 0; i < count; i++) {
+        gc_object_t *ptr = start + i * stride;
+        ptr->color = WHITE;
+        ptr->age = 0;
+        ptr->flags = 0;
+        ptr->site = site;
+        ptr->forward = 0;
+        // the reservation is walkable as soon as it is handed out
+        ptr->obj.object_header = fields_count << 4;
+        gc_update_stats_after_object_alloc(stride);
+        if (gc_is_shared()) {
+            continue;
+        }
+        gc_site_alloc(site, stride, false);
+        if (gc->phase == MARK) {
+            make_stella_object_grey_if_needed(&ptr->obj);
+        } else {
+            push(gc->sweep_helper.allocated, ptr);
+        }
+    }
+    return &((gc_object_t *) start)->obj;
+}
+
+void gc_object_allocated(void *object) {
+    gc_object_t *gc_obj = stella_object_to_gc_object(object);
+    const int tag = STELLA_OBJECT_HEADER_TAG(gc_obj->obj.object_header);
+    if (gc_is_shared()) {
+        // the tag profile is updated when the TLAB is flushed
+        if (gc->sampler.enabled) {
+            pthread_mutex_lock(&gc->lock);
+            if (gc_sampler_should_sample(&gc->sampler, get_gc_object_size(gc_obj))) {
+                size_t sample = gc_sampler_take(&gc->sampler, tag, get_gc_object_size(gc_obj));
+                gc_weak_put(&gc->sampler.live, object, sample);
+            }
+            pthread_mutex_unlock(&gc->lock);
+        }
+    } else if (!gc_is_in_mature(object)) {
+        // mature objects are never copied, they would all count as deaths
+        if (gc->phase == SWEEP) {
+            gc_tag_profile_alloc_next(&gc->tags, tag, get_gc_object_size(gc_obj));
+        } else {
+            gc_tag_profile_alloc(&gc->tags, tag, get_gc_object_size(gc_obj));
+        }
+        if (gc->sampler.enabled && gc_sampler_should_sample(&gc->sampler, get_gc_object_size(gc_obj))) {
+            size_t sample = gc_sampler_take(&gc->sampler, tag, get_gc_object_size(gc_obj));
+            gc_weak_put(&gc->sampler.live, object, sample);
+        }
+    }
+    if (gc_record_enabled) {
+        gc_record_alloc(object, tag, STELLA_OBJECT_HEADER_FIELD_COUNT(gc_obj->obj.object_header));
+    }
+}
+
+void gc_start_alloc_sampling(uint64_t interval) {
+    gc_init();
+    if (!gc->sampler.enabled) {
+        gc_register_weak_map(&gc->sampler.live);
+    }
+    gc_sampler_start(&gc->sampler, interval);
+}
+
+bool gc_write_alloc_profile(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        printf("Failed to open allocation profile file %s\n", path);
+        return false;
+    }
+    bool ok = gc_sampler_write_folded(&gc->sampler, out);
+    return fclose(out) == 0 && ok;
+}
+
+void gc_register_weak_map(gc_weak_map_t *map) {
+    gc_init();
+    if (gc->weak_maps_count == GC_MAX_WEAK_MAPS) {
+        printf("Too many weak maps registered\n");
+        exit(1);
+    }
+    gc->weak_maps[gc->weak_maps_count++] = map;
+}
+
+void gc_unregister_weak_map(gc_weak_map_t *map) {
+    for (int i = 0; i < gc->weak_maps_count; i++) {
+        if (gc->weak_maps[i] == map) {
+            gc->weak_maps[i] = gc->weak_maps[--gc->weak_maps_count];
+            return;
+        }
+    }
+}
+
+void gc_weak_put(gc_weak_map_t *map, void *object, uint64_t value) {
+    if (is_in_current_heap(object)) {
+        stella_object_to_gc_object(object)->flags |= GC_OBJECT_WEAK_KEY;
+    }
+    gc_weak_map_put(map, object, value);
+}
+
+static void print_root_stack(gc_root_stack_t *stack, void *data) {
+    for (int i = 0; i < stack->roots_cont; i++) {
+        printf("%p ", stack->roots[i]);
+    }
+}
+
 void print_gc_roots() {
     printf("ROOTS: ");
-    for (int i = 0; i < gc->roots_cont; i++) {
-        printf("%p ", gc->roots[i]);
-    }
+    gc_visit_root_stacks(print_root_stack, NULL);
     printf("\n");
 }
 
 void print_gc_alloc_stats() {
-    printf("Total memory allocation:            %ld'd bytes (%lu'd objects)\n", gc->stats.total_allocated_bytes, gc->stats.total_allocated_objects);
-    printf("Maximum residency:                  %lu'd bytes (%lu'd objects)\n", gc->stats.max_allocated_bytes, gc->stats.max_allocated_objects);
-    printf("Total memory use:                   %lu'd reads and %lu'd writes\n", gc->stats.total_reads, gc->stats.total_writes);
-    printf("Allocations after last sweep:       %lu'd bytes and %lu'd objects\n", gc->stats.current_allocated_bytes, gc->stats.current_allocated_objects);
-    printf("Max GC roots stack size:            %lu roots\n", gc->stats.gc_roots_max_size);
-    printf("Marked objects:                     %lu\n", gc->stats.marked_objects);
-    printf("Mark phases done:                   %lu\n", gc->stats.mark_phase_count);
-    printf("Mark steps done:                    %lu\n", gc->stats.mark_steps);
-    printf("Sweep phases done:                  %lu\n", gc->stats.sweep_phase_count);
-    printf("Sweep steps done:                   %lu\n", gc->stats.sweep_steps);
+    gc_safepoint_begin();
+    gc_stats_t stats = gc_aggregate_stats();
+    gc_pause_stats_t pause_stats = gc_get_pause_stats();
+    const gc_intern_table_t intern = gc->intern;
+    gc_safepoint_end();
+    printf("Total memory allocation:            %'lu bytes (%'lu objects)\n", stats.total_allocated_bytes, stats.total_allocated_objects);
+    printf("Maximum residency:                  %'lu bytes (%'lu objects)\n", stats.max_residency_bytes, stats.max_residency_objects);
+    printf("Total memory use:                   %'lu reads and %'lu writes\n", stats.total_reads, stats.total_writes);
+    printf("Allocations after last sweep:       %'lu bytes and %'lu objects\n", stats.current_allocated_bytes, stats.current_allocated_objects);
+    printf("Max GC roots stack size:            %lu roots\n", stats.gc_roots_max_size);
+    printf("Marked objects:                     %lu\n", stats.marked_objects);
+    printf("Mark phases done:                   %lu\n", stats.mark_phase_count);
+    printf("Mark steps done:                    %lu\n", stats.mark_steps);
+    printf("Sweep phases done:                  %lu\n", stats.sweep_phase_count);
+    printf("Sweep steps done:                   %lu\n", stats.sweep_steps);
+    if (intern.enabled) {
+        printf("Hash-consing:                       %'lu shared, %'lu interned, %'lu live entries\n",
+               intern.hits, intern.misses, (unsigned long) intern.count);
+    }
+    gc_pause_stats_print(&pause_stats);
+}
+
+void gc_get_stats(gc_stats_snapshot_t *stats) {
+    gc_init();
+    gc_safepoint_begin();
+    const gc_stats_t totals = gc_aggregate_stats();
+    stats->total_allocated_bytes = totals.total_allocated_bytes;
+    stats->total_allocated_objects = totals.total_allocated_objects;
+    stats->max_residency_bytes = totals.max_residency_bytes;
+    stats->max_residency_objects = totals.max_residency_objects;
+    stats->last_residency_bytes = totals.last_residency_bytes;
+    stats->last_residency_objects = totals.last_residency_objects;
+    stats->current_allocated_bytes = totals.current_allocated_bytes;
+    stats->current_allocated_objects = totals.current_allocated_objects;
+    stats->total_reads = totals.total_reads;
+    stats->total_writes = totals.total_writes;
+    stats->gc_roots_max_size = totals.gc_roots_max_size;
+    stats->mark_steps = totals.mark_steps;
+    stats->sweep_steps = totals.sweep_steps;
+    stats->mark_phase_count = totals.mark_phase_count;
+    stats->sweep_phase_count = totals.sweep_phase_count;
+    stats->marked_objects = totals.marked_objects;
+    stats->heap_size = gc->current_heap_size;
+    stats->phase = gc->phase;
+    gc_pause_tracker_collect(&gc->pauses, &stats->pauses);
+    gc_safepoint_end();
+}
+
+bool gc_shm_open(const char *path) {
+    gc_init();
+    gc_shm_close();
+    gc->shm = gc_shm_map(path);
+    return gc->shm != NULL;
+}
+
+void gc_shm_close() {
+    if (gc != NULL && gc->shm != NULL) {
+        gc_shm_unmap(gc->shm);
+        gc->shm = NULL;
+    }
+}
+
+void gc_publish_shm_stats() {
+    const gc_histogram_t *steps = &gc->pauses.histograms[GC_PAUSE_STEP];
+    const gc_histogram_t *full = &gc->pauses.histograms[GC_PAUSE_FULL];
+    const gc_stats_t stats = gc_aggregate_stats();
+    gc_shm_sample_t sample = {
+        .timestamp_ns = gc_clock_ns(),
+        .total_allocated_bytes = stats.total_allocated_bytes,
+        .total_allocated_objects = stats.total_allocated_objects,
+        .live_bytes = stats.last_residency_bytes,
+        .max_live_bytes = stats.max_residency_bytes,
+        .heap_size = gc->current_heap_size,
+        .phase = gc->phase,
+        .mark_phase_count = stats.mark_phase_count,
+        .sweep_phase_count = stats.sweep_phase_count,
+        .total_reads = stats.total_reads,
+        .total_writes = stats.total_writes,
+        .total_gc_ns = gc->pauses.total_gc_ns,
+        .max_pause_ns = steps->max_ns > full->max_ns ? steps->max_ns : full->max_ns,
+    };
+    gc_shm_publish(gc->shm, &sample);
+}
+
+void print_gc_tag_profile() {
+    gc_tag_profile_print(&gc->tags);
+}
+
+gc_pause_stats_t gc_get_pause_stats() {
+    gc_pause_stats_t stats;
+    gc_pause_tracker_collect(&gc->pauses, &stats);
+    return stats;
+}
+
+void gc_set_mmu_windows(const uint64_t *windows_ns, int count) {
+    gc_init();
+    gc_pause_tracker_set_mmu_windows(&gc->pauses, windows_ns, count);
 }
 
 void print_gc_state() {
-    // TODO: not implemented
+    printf("Phase:                              %s\n", gc->phase == MARK ? "mark" : "sweep");
+    printf("Heap:                               %p - %p (%lu bytes)\n", gc->current_heap,
+           gc->current_heap + gc->current_heap_size, gc->current_heap_size);
+    printf("Next free place in heap:            %p (%lu bytes used)\n", gc->next_place_in_heap,
+           (unsigned long) (gc->next_place_in_heap - gc->current_heap));
+    if (gc->phase == SWEEP) {
+        printf("To-space:                           %p - %p (%lu bytes)\n", gc->sweep_helper.next_heap,
+               gc->sweep_helper.next_heap + gc->sweep_helper.next_heap_size, gc->sweep_helper.next_heap_size);
+        printf("Next free place in to-space:        %p (%lu bytes copied)\n", gc->sweep_helper.next,
+               gc->sweep_helper.sweep_allocated_bytes);
+    }
+    const gc_stats_t stats = gc_aggregate_stats();
+    printf("Allocations after last sweep:       %'lu bytes and %'lu objects\n", stats.current_allocated_bytes, stats.current_allocated_objects);
+    printf("Grey queue empty:                   %s\n", is_empty(gc->grey_queue) ? "yes" : "no");
+    printf("Black queue empty:                  %s\n", is_empty(gc->black_queue) ? "yes" : "no");
+    if (gc->soft_heap_limit != 0 || gc->hard_heap_limit != 0) {
+        printf("Heap limits (0 is none):            soft %lu bytes, hard %lu bytes\n",
+               (unsigned long) gc->soft_heap_limit, (unsigned long) gc->hard_heap_limit);
+    }
+    printf("Field classification:               %s\n", gc_simd_kernel_name());
+    print_gc_roots();
 }
 
 void gc_read_barrier(void *object, int field_index) {
-    gc->stats.total_reads += 1;
+    gc_mutator->stats.reads += 1;
+    if (gc_record_enabled) {
+        gc_record_read(object, field_index);
+    }
 }
 
 void gc_write_barrier(void *object, int field_index, void *contents) {
     // gc_object_t *obj = stella_object_to_gc_object((stella_object*) contents);
-    make_stella_object_grey_if_needed((stella_object *) contents);
-    gc->stats.total_writes += 1;
+    if (gc->images_count > 0 && !is_in_current_heap(object) && gc_is_in_image(object)) {
+        gc_remember_image_write(object, contents);
+    }
+    if (gc_is_shared()) {
+        // collector queues are only touched at safepoints
+        if (gc->phase == MARK) {
+            if ((is_in_current_heap(contents) || gc_is_in_mature(contents))
+            && stella_object_to_gc_object(contents)->color == WHITE) {
+                gc_barrier_buffer_push(contents);
+            }
+        } else if (is_in_current_heap(object)) {
+            gc_object_t *copy = gc_forwarded(stella_object_to_gc_object(object));
+            if (copy != NULL) {
+                copy->obj.object_fields[field_index] = contents;
+                gc_barrier_buffer_push(copy);
+            }
+        }
+    } else if (gc->phase == MARK) {
+        make_stella_object_grey_if_needed((stella_object *) contents);
+    } else if (is_in_current_heap(object)) {
+        // the mutator keeps using from-space until the flip, an existing copy must see the write too
+        gc_object_t *copy = gc_forwarded(stella_object_to_gc_object(object));
+        if (copy != NULL) {
+            copy->obj.object_fields[field_index] = contents;
+            push(gc->black_queue, copy);
+        }
+    }
+    gc_mutator->stats.writes += 1;
+    if (gc_record_enabled) {
+        gc_record_write(object, field_index, contents);
+    }
 }
 
 void gc_push_root(void **ptr) {
     gc_init();
-    gc->roots[gc->roots_cont++] = (stella_object *) ptr;
+    if (gc_record_enabled) {
+        gc_record_push_root(*ptr);
+    }
+    gc_root_stack_t *stack = gc_mutator->stack;
+    if (stack->roots_cont == stack->capacity) {
+        gc_root_stack_grow(stack);
+    }
+    stack->roots[stack->roots_cont++] = (stella_object **) ptr;
 #ifdef STELLA_DEBUG
-    printf("Root (%d): %p\n", gc->roots_cont - 1, *ptr);
+    printf("Root (%d): %p\n", stack->roots_cont - 1, *ptr);
 #endif
-    if (gc->roots_cont > gc->stats.gc_roots_max_size) {
-        gc->stats.gc_roots_max_size = gc->roots_cont;
+    if (stack->roots_cont > gc_mutator->stats.roots_max_size) {
+        gc_mutator->stats.roots_max_size = stack->roots_cont;
     }
 }
 
 void gc_pop_root(void **ptr) {
-    gc->roots_cont--;
+    gc_mutator->stack->roots_cont--;
+    if (gc_record_enabled) {
+        gc_record_pop_root();
+    }
 }
 
 typedef enum SWEEP_STRATEGY {
     MAKE_BIGGER,
     MAKE_SMALLER,
+    KEEP_SIZE,
     DO_NOTHING
 } SWEEP_STRATEGY;
 
+// incremental cycles grow the heap up to the soft limit, allocation failures up to the hard one; 0 is none
+static size_t growth_limit(bool past_soft_limit) {
+    size_t limit = past_soft_limit ? 0 : gc->soft_heap_limit;
+    if (gc->hard_heap_limit != 0 && (limit == 0 || limit > gc->hard_heap_limit)) {
+        limit = gc->hard_heap_limit;
+    }
+    return limit;
+}
+
+// twice the heap, within limit and GC_MAX_HEAP_SIZE but never smaller than the heap
+static size_t grown_heap_size(size_t limit) {
+    size_t size = gc->current_heap_size * 2;
+    if (limit == 0 || limit > GC_MAX_HEAP_SIZE) {
+        limit = GC_MAX_HEAP_SIZE;
+    }
+    if (size > limit) {
+        size = limit > gc->current_heap_size ? limit : gc->current_heap_size;
+    }
+    return size;
+}
+
 SWEEP_STRATEGY sweep_strategy() {
-    float allocated = gc->stats.current_allocated_bytes;
+    float used = gc->next_place_in_heap - gc->current_heap;
+    float live = gc->marked_bytes;
     float heap_size = gc->current_heap_size;
 #ifdef STELLA_DEBUG
-    printf("allocated / heap_size = %f\n", allocated / heap_size);
+    printf("used / heap_size = %f, live / heap_size = %f\n", used / heap_size, live / heap_size);
 #endif
-    // heap almost full
-    if (allocated / heap_size > 0.7) {
-        return MAKE_BIGGER;
-        // heap almost empty
+    // there are enough place in heap, keep allocating
+    if (used / heap_size < 0.7) {
+        return DO_NOTHING;
+    }
+    // live data would leave little room after the copy; at the soft limit the copy compacts instead
+    if (live / heap_size > 0.5) {
+        return grown_heap_size(growth_limit(false)) > gc->current_heap_size ? MAKE_BIGGER : KEEP_SIZE;
     }
-    if (allocated / heap_size < 0.2) {
+    // heap almost empty, or past the soft limit with live data which fits back under it
+    const bool past_soft_limit = gc->soft_heap_limit != 0 && gc->current_heap_size > gc->soft_heap_limit;
+    if ((live / heap_size < 0.125 || (past_soft_limit && live / heap_size < 0.25))
+        && gc->current_heap_size / 2 >= gc->min_heap_size) {
         return MAKE_SMALLER;
-        // there are enough place in heap
     }
-    return DO_NOTHING;
-}
-
-static bool is_in_current_heap(void *ptr) {
-    return ptr >= gc->current_heap && ptr < gc->current_heap + gc->current_heap_size;
-}
-
-static bool is_in_next_heap(void *ptr) {
-    return ptr >= gc->sweep_helper.next_heap && ptr < gc->sweep_helper.next_heap + gc->sweep_helper.next_heap_size;
+    return KEEP_SIZE;
 }
 
 void has_ill_fields_rec(gc_object_t *object) {
@@ -329,7 +783,7 @@ void has_ill_fields_rec(gc_object_t *object) {
         // printf("\n");
         // fflush(stdout);
     } else {
-        int fields_count = STELLA_OBJECT_HEADER_FIELD_COUNT(object->obj.object_header);
+        int fields_count = STELLA_OBJECT_HEADER_POINTER_COUNT(object->obj.object_header);
         for (int i = 0; i < fields_count; i++) {
             has_ill_fields_rec(stella_object_to_gc_object(object->obj.object_fields[i]));
         }
@@ -342,50 +796,170 @@ void *sweep_forward(stella_object *stella_obj) {
         return stella_obj;
     }
     gc_object_t *gc_obj = stella_object_to_gc_object(stella_obj);
-    if (is_in_next_heap(gc_obj->moved_to)) {
-        return gc_obj->moved_to;
+    if (gc_obj->forward == 0) {
+        if (gc->copy_order == GC_COPY_DEPTH_FIRST) {
+            sweep_copy_group(gc_obj);
+        } else {
+            sweep_chase(gc_obj);
+        }
+    }
+    return &gc_forwarded(gc_obj)->obj;
+}
+
+// copy one object to to-space, its fields are forwarded when the copy leaves the black queue
+static gc_object_t *sweep_copy(gc_object_t *old_gc_obj) {
+    gc_object_t *q = try_alloc_in_next(get_gc_object_size(old_gc_obj));
+    if (q == NULL) {
+        printf("Failed to allocate gc_object in sweep phase\n");
+        exit(1);
+    }
+    const int field_count = STELLA_OBJECT_HEADER_FIELD_COUNT(old_gc_obj->obj.object_header);
+
+    q->forward = 0;
+    q->color = WHITE;
+    q->flags = old_gc_obj->flags;
+    q->site = old_gc_obj->site;
+    gc_site_survive(old_gc_obj->site, old_gc_obj->age);
+    q->obj.object_header = old_gc_obj->obj.object_header;
+    q->age = gc_tag_profile_survive(&gc->tags, STELLA_OBJECT_HEADER_TAG(q->obj.object_header),
+                                    get_gc_object_size(q), old_gc_obj->age);
+    for (int i = 0; i < field_count; i++) {
+        q->obj.object_fields[i] = old_gc_obj->obj.object_fields[i];
+    }
+
+    if (old_gc_obj->flags & GC_OBJECT_WEAK_KEY) {
+        for (int i = 0; i < gc->weak_maps_count; i++) {
+            gc_weak_map_moved(gc->weak_maps[i], &old_gc_obj->obj, &q->obj);
+        }
     }
-    sweep_chase(gc_obj);
-    return gc_obj->moved_to;
+    gc->sweep_helper.sweep_allocated_bytes += get_gc_object_size(q);
+    gc->sweep_helper.sweep_allocated_objects += 1;
+    gc_set_forwarded(old_gc_obj, q);
+    // to fix fields addresses after sweep
+    push(gc->black_queue, q);
+    return q;
 }
 
 void sweep_chase(gc_object_t *old_gc_obj) {
     do {
-        gc_object_t *q = try_alloc_in_next(get_gc_object_size(old_gc_obj));
-        if (q == NULL) {
-            printf("Failed to allocate gc_object in sweep phase\n");
-            exit(1);
-        }
-        const int field_count = STELLA_OBJECT_HEADER_FIELD_COUNT(old_gc_obj->obj.object_header);
+        gc_object_t *q = sweep_copy(old_gc_obj);
+        const int field_count = STELLA_OBJECT_HEADER_POINTER_COUNT(q->obj.object_header);
         void *r = NULL;
+        for (uint64_t mask = heap_fields_mask(q->obj.object_fields, field_count); mask != 0; mask &= mask - 1) {
+            gc_object_t *field = stella_object_to_gc_object(q->obj.object_fields[__builtin_ctzll(mask)]);
+            if (field->forward == 0) {
+                r = field;
+            }
+        }
+        old_gc_obj = r;
+    } while (old_gc_obj != NULL);
+}
 
-        q->moved_to = NULL;
-        q->color = WHITE;
-        q->obj.object_header = old_gc_obj->obj.object_header;
-        for (int i = 0; i < field_count; i++) {
-            q->obj.object_fields[i] = old_gc_obj->obj.object_fields[i];
+void sweep_forward_fields(gc_object_t *obj) {
+    const int field_count = STELLA_OBJECT_HEADER_POINTER_COUNT(obj->obj.object_header);
+    for (uint64_t mask = heap_fields_mask(obj->obj.object_fields, field_count); mask != 0; mask &= mask - 1) {
+        void **slot = &obj->obj.object_fields[__builtin_ctzll(mask)];
+        *slot = sweep_forward(*slot);
+    }
+}
 
-            if (is_in_current_heap(q->obj.object_fields[i])) {
-                gc_object_t *potentially_forwarded = stella_object_to_gc_object(q->obj.object_fields[i]);
+static void copy_stack_push(gc_object_t *obj) {
+    if (gc->copy_stack_count == gc->copy_stack_capacity) {
+        size_t capacity = gc->copy_stack_capacity == 0 ? 64 : gc->copy_stack_capacity * 2;
+        gc_object_t **stack = realloc(gc->copy_stack, capacity * sizeof(gc_object_t *));
+        if (stack == NULL) {
+            printf("Memory allocation for copy stack failed!\n");
+            exit(1);
+        }
+        gc->copy_stack = stack;
+        gc->copy_stack_capacity = capacity;
+    }
+    gc->copy_stack[gc->copy_stack_count++] = obj;
+}
 
-                if (!is_in_next_heap(potentially_forwarded->moved_to)) {
-                    r = potentially_forwarded;
-                }
+void sweep_copy_group(gc_object_t *old_gc_obj) {
+    size_t copied = 0;
+    gc->copy_stack_count = 0;
+    copy_stack_push(old_gc_obj);
+    while (gc->copy_stack_count > 0 && copied < GC_COPY_GROUP_BYTES) {
+        gc_object_t *obj = gc->copy_stack[--gc->copy_stack_count];
+        if (obj->forward != 0) {
+            continue;
+        }
+        gc_object_t *q = sweep_copy(obj);
+        copied += get_gc_object_size(q);
+        // pushed last to first, so that the first field is copied right after its parent
+        const int field_count = STELLA_OBJECT_HEADER_POINTER_COUNT(q->obj.object_header);
+        uint64_t mask = heap_fields_mask(q->obj.object_fields, field_count);
+        while (mask != 0) {
+            const int last = 63 - __builtin_clzll(mask);
+            mask &= ~(1ull << last);
+            gc_object_t *field = stella_object_to_gc_object(q->obj.object_fields[last]);
+            if (field->forward == 0) {
+                copy_stack_push(field);
             }
         }
+    }
+    gc->copy_stack_count = 0;
+}
 
-        old_gc_obj->moved_to = q;
-        old_gc_obj = r;
-        // to fix fields addresses after sweep
-        push(gc->black_queue, q);
-    } while (old_gc_obj != NULL);
+void gc_set_copy_order(GC_COPY_ORDER order) {
+    gc_init();
+    gc->copy_order = order;
+}
+
+// returns the oldest entry once the ring is full, NULL otherwise
+static void *prefetch_ring_push(gc_prefetch_ring_t *ring, void *entry) {
+    void *oldest = NULL;
+    if (ring->count == GC_PREFETCH_DISTANCE) {
+        oldest = ring->entries[ring->head];
+        ring->head = (ring->head + 1) % GC_PREFETCH_DISTANCE;
+        ring->count -= 1;
+    }
+    ring->entries[(ring->head + ring->count) % GC_PREFETCH_DISTANCE] = entry;
+    ring->count += 1;
+    return oldest;
+}
+
+static void *prefetch_ring_pop(gc_prefetch_ring_t *ring) {
+    if (ring->count == 0) {
+        return NULL;
+    }
+    void *oldest = ring->entries[ring->head];
+    ring->head = (ring->head + 1) % GC_PREFETCH_DISTANCE;
+    ring->count -= 1;
+    return oldest;
+}
+
+// the slot is read again, the mutator may have written it while it waited
+static void forward_slot(void **slot) {
+    *slot = sweep_forward(*slot);
+}
+
+static void forward_slot_prefetched(void **slot) {
+    __builtin_prefetch(stella_object_to_gc_object(*slot));
+    void **ready = prefetch_ring_push(&gc->copy_prefetch, slot);
+    if (ready != NULL) {
+        forward_slot(ready);
+    }
 }
 
 bool sweep_step() {
     if (is_empty(gc->black_queue)) {
-        return true;
+        if (gc->copy_prefetch.count == 0) {
+            return true;
+        }
+        // forwarding the last slots may copy more objects
+        void **slot;
+        while ((slot = prefetch_ring_pop(&gc->copy_prefetch)) != NULL) {
+            forward_slot(slot);
+        }
+        return false;
     }
     gc_object_t *black_obj = get(gc->black_queue);
+    if (!is_empty(gc->black_queue)) {
+        __builtin_prefetch(peek(gc->black_queue));
+    }
     gc->stats.sweep_steps += 1;
     if (is_in_current_heap(black_obj)) {
 #ifdef STELLA_DEBUG
@@ -394,11 +968,11 @@ bool sweep_step() {
         printf("\n");
 #endif
         sweep_forward(&black_obj->obj);
-        push(gc->black_queue, black_obj->moved_to);
+        push(gc->black_queue, gc_forwarded(black_obj));
 #ifdef STELLA_DEBUG
         printf("Swept object: ");
-        print_stella_object(&black_obj->moved_to->obj);
-        printf(", from %p to %p \n", black_obj, black_obj->moved_to);
+        print_stella_object(&gc_forwarded(black_obj)->obj);
+        printf(", from %p to %p \n", black_obj, gc_forwarded(black_obj));
 #endif
     } else {
         // to change fields addresses
@@ -407,21 +981,20 @@ bool sweep_step() {
         printf("Swept object fields:\n ptr: %p\n object: ", black_obj);
         print_stella_object(&black_obj->obj);
 #endif
-        int field_count = STELLA_OBJECT_HEADER_FIELD_COUNT(black_obj->obj.object_header);
+        int field_count = STELLA_OBJECT_HEADER_POINTER_COUNT(black_obj->obj.object_header);
 #ifdef STELLA_DEBUG
         printf("\n fields count: %d\n", field_count);
 #endif
-        for (int i = 0; i < field_count; i++) {
-            stella_object *cur_field = black_obj->obj.object_fields[i];
+        // fields written after the copy may refer to objects which are not copied yet
+        for (uint64_t mask = heap_fields_mask(black_obj->obj.object_fields, field_count); mask != 0;
+             mask &= mask - 1) {
+            const int i = __builtin_ctzll(mask);
 #ifdef STELLA_DEBUG
             printf("  field %d: ", i);
-            print_stella_object(cur_field);
+            print_stella_object(black_obj->obj.object_fields[i]);
             printf("\n");
 #endif
-            if (is_in_current_heap(cur_field)) {
-                gc_object_t *moved_field = stella_object_to_gc_object(cur_field)->moved_to;
-                black_obj->obj.object_fields[i] = &moved_field->obj;
-            }
+            forward_slot_prefetched(&black_obj->obj.object_fields[i]);
         }
     }
     return false;
@@ -431,31 +1004,42 @@ void *alloc_heap(size_t size) {
 #ifdef STELLA_DEBUG
     printf("Size to alloc %u, ", size);
 #endif
-    void *heap = malloc(size);
-    if (heap == NULL) {
-        printf("Memory allocation for new heap failed!\n");
-        exit(1);
+    // forwarding references do not reach further
+    if (size > GC_MAX_HEAP_SIZE) {
+        return NULL;
     }
+    void *heap = malloc(size);
 #ifdef STELLA_DEBUG
     printf("heap from %p to %p \n", heap, heap + size);
 #endif
     return heap;
 }
 
-SWEEP_STRATEGY sweep_prepare(bool ignore_strategy) {
-    SWEEP_STRATEGY strategy = sweep_strategy();
-    if (ignore_strategy) {
-        strategy = MAKE_BIGGER;
-    }
+// allocate to-space for a copy, MAKE_BIGGER growing the heap within limit; DO_NOTHING if marking
+// goes on instead, also when there is no memory for any to-space
+SWEEP_STRATEGY sweep_prepare(SWEEP_STRATEGY strategy, size_t limit) {
+    size_t size = gc->current_heap_size;
     switch (strategy) {
         case MAKE_BIGGER:
-            gc_init_sweep_helper(gc->current_heap_size * 2);
+            size = grown_heap_size(limit);
             break;
         case MAKE_SMALLER:
-            gc_init_sweep_helper(gc->current_heap_size / 2);
+            size = gc->current_heap_size / 2;
             break;
-        case DO_NOTHING:
+        case KEEP_SIZE:
             break;
+        case DO_NOTHING:
+            return DO_NOTHING;
+    }
+    if (!gc_init_sweep_helper(size)) {
+        // a to-space of the same size still compacts the heap
+        if (size == gc->current_heap_size || !gc_init_sweep_helper(gc->current_heap_size)) {
+            return DO_NOTHING;
+        }
+        strategy = KEEP_SIZE;
+    }
+    if (gc->sweep_helper.next_heap_size != gc->current_heap_size) {
+        GC_TRACE(GC_TRACE_HEAP_RESIZE, GC_TRACE_INSTANT, gc->sweep_helper.next_heap_size);
     }
 #ifdef STELLA_DEBUG
     printf("Sweeping strategy: %d\n", strategy);
@@ -463,13 +1047,9 @@ SWEEP_STRATEGY sweep_prepare(bool ignore_strategy) {
     return strategy;
 }
 
-void sweep_cleanup() {
-#ifdef STELLA_DEBUG
-    printf("Sweep cleanup\n");
-#endif
-    // moving roots links
-    for (int i = 0; i < gc->roots_cont; i++) {
-        stella_object *current_root = *(gc->roots[i]);
+static void sweep_root_stack(gc_root_stack_t *stack, void *data) {
+    for (int i = 0; i < stack->roots_cont; i++) {
+        stella_object *current_root = *(stack->roots[i]);
         if (is_in_current_heap(current_root)) {
 #ifdef STELLA_DEBUG
             printf("Sweeping root (%d): ", i);
@@ -477,21 +1057,60 @@ void sweep_cleanup() {
                 printf("Anime!");
             }
             print_stella_object(current_root);
-            printf("\n from %p to %p\n", stella_object_to_gc_object(current_root), stella_object_to_gc_object(current_root)->moved_to);
+            printf("\n from %p to %p\n", stella_object_to_gc_object(current_root), gc_forwarded(stella_object_to_gc_object(current_root)));
             fflush(stdout);
-            has_ill_fields_rec(stella_object_to_gc_object(current_root)->moved_to);
+            has_ill_fields_rec(gc_forwarded(stella_object_to_gc_object(current_root)));
 #endif
-            *(gc->roots[i]) = &stella_object_to_gc_object(current_root)->moved_to->obj;
+            *(stack->roots[i]) = sweep_forward(current_root);
         }
     }
+}
+
+void sweep_cleanup() {
+    uint64_t pause_start = gc_pause_begin(&gc->pauses);
+#ifdef STELLA_DEBUG
+    printf("Sweep cleanup\n");
+#endif
+    // TLABs in to-space end here, their objects have been flushed to the allocated queue
+    gc_mutators_retire_tlabs();
+    // objects allocated while copying still refer to from-space
+    while (!is_empty(gc->sweep_helper.allocated)) {
+        sweep_forward_fields(get(gc->sweep_helper.allocated));
+    }
+    // moving roots links
+    gc_visit_root_stacks(sweep_root_stack, NULL);
+    gc_root_stacks_flip();
+    sweep_remembered_set();
+    sweep_mature_space();
+    // copies made above
+    while (!sweep_step()) {
+    }
+    gc_update_stats_after_flip();
+    gc_tag_profile_flip(&gc->tags);
+    // keys which are still in from-space were not copied
+    for (int i = 0; i < gc->weak_maps_count; i++) {
+        gc_weak_map_sweep(gc->weak_maps[i], is_dead_at_flip);
+    }
+    sweep_intern_table();
+    gc_mature_space_flip();
+    gc_pretenure_flip();
     free(gc->current_heap);
     gc->current_heap = gc->sweep_helper.next_heap;
     gc->current_heap_size = gc->sweep_helper.next_heap_size;
     gc->stats.current_allocated_bytes = 0;
     gc->stats.current_allocated_objects = 0;
+    for (gc_mutator_t *mutator = gc->mutators; mutator != NULL; mutator = mutator->next) {
+        mutator->stats.current_allocated_bytes = 0;
+        mutator->stats.current_allocated_objects = 0;
+    }
+    gc->marked_bytes = 0;
     gc->next_place_in_heap = gc->sweep_helper.next;
+    GC_TRACE(GC_TRACE_SWEEP_PHASE, GC_TRACE_END, 0);
+    GC_TRACE(GC_TRACE_FLIP, GC_TRACE_INSTANT, gc->next_place_in_heap - gc->current_heap);
     gc->phase = MARK;
     gc->stats.mark_phase_count += 1;
+    GC_TRACE(GC_TRACE_MARK_PHASE, GC_TRACE_BEGIN, 0);
+    gc_pause_end(&gc->pauses, GC_PAUSE_CLEANUP, pause_start);
 }
 
 gc_object_t *stella_object_to_gc_object(void *ptr) {
@@ -510,7 +1129,7 @@ void make_stella_object_grey_if_needed(stella_object *stella_obj) {
     print_stella_object(stella_obj);
     printf(", ");
 #endif
-    if (!is_in_current_heap(stella_obj)) {
+    if (!is_in_current_heap(stella_obj) && !gc_is_in_mature(stella_obj)) {
 #ifdef STELLA_DEBUG
         printf(" not in current heap\n");
 #endif
@@ -532,31 +1151,69 @@ void make_stella_object_grey_if_needed(stella_object *stella_obj) {
 #endif
 }
 
+// active root stacks only, suspended ones are scanned by mark_next_suspended_root_stack
 void mark_roots() {
-    for (int i = 0; i < gc->roots_cont; i++) {
-        stella_object *current_root = *(gc->roots[i]);
-        // if root is allocated we can just mark it as grey and traverse it's children later
-        if (is_in_current_heap(current_root)) {
-            fflush(stdout);
+    gc_root_stack_t *primary_stack = gc->primary.stack;
+    GC_TRACE(GC_TRACE_ROOT_SCAN, GC_TRACE_BEGIN, primary_stack->roots_cont);
+    if (gc_record_enabled) {
+        gc_record_sync_roots((void ***) primary_stack->roots, primary_stack->roots_cont);
+    }
+    for (gc_mutator_t *mutator = gc->mutators; mutator != NULL; mutator = mutator->next) {
+        gc_root_stack_t *stack = mutator->stack;
+        for (int i = 0; i < stack->roots_cont; i++) {
+            stella_object *current_root = *(stack->roots[i]);
+            // if root is allocated we can just mark it as grey and traverse it's children later
             make_stella_object_grey_if_needed(current_root);
         }
     }
+    mark_remembered_set();
+    GC_TRACE(GC_TRACE_ROOT_SCAN, GC_TRACE_END, primary_stack->roots_cont);
+}
+
+// the field is greyed a few fields later, once its header has been prefetched
+static void mark_field_prefetched(stella_object *field) {
+    __builtin_prefetch(stella_object_to_gc_object(field), 1);
+    stella_object *ready = prefetch_ring_push(&gc->mark_prefetch, field);
+    if (ready != NULL) {
+        make_stella_object_grey_if_needed(ready);
+    }
 }
 
 // returns true if everything marked, false otherwise
 bool mark_step() {
     gc->stats.mark_steps += 1;
     if (is_empty(gc->grey_queue)) {
+        stella_object *field;
+        while ((field = prefetch_ring_pop(&gc->mark_prefetch)) != NULL) {
+            make_stella_object_grey_if_needed(field);
+        }
+    }
+    if (is_empty(gc->grey_queue)) {
+        // one suspended root stack per step, the active ones once all of them are done
+        if (mark_next_suspended_root_stack()) {
+            return false;
+        }
         mark_roots();
     }
     if (!is_empty(gc->grey_queue)) {
         gc_object_t *obj = get(gc->grey_queue);
-        const int fields_count = STELLA_OBJECT_HEADER_FIELD_COUNT(obj->obj.object_header);
-        for (int i = 0; i < fields_count; i++) {
-            make_stella_object_grey_if_needed(obj->obj.object_fields[i]);
+        if (!is_empty(gc->grey_queue)) {
+            __builtin_prefetch(peek(gc->grey_queue));
+        }
+        const int fields_count = STELLA_OBJECT_HEADER_POINTER_COUNT(obj->obj.object_header);
+        uint64_t mask = heap_fields_mask(obj->obj.object_fields, fields_count);
+        if (gc->mature.start != NULL) {
+            mask |= gc_fields_in_range(obj->obj.object_fields, fields_count, gc->mature.start, gc->mature.top);
+        }
+        for (; mask != 0; mask &= mask - 1) {
+            mark_field_prefetched(obj->obj.object_fields[__builtin_ctzll(mask)]);
         }
         obj->color = BLACK;
-        push(gc->black_queue, obj);
+        // mature objects stay where they are, their fields are forwarded at flip
+        if (is_in_current_heap(obj)) {
+            gc->marked_bytes += get_gc_object_size(obj);
+            push(gc->black_queue, obj);
+        }
         // there are something to do
         return false;
     } else {
@@ -565,29 +1222,104 @@ bool mark_step() {
     }
 }
 
-void gc_full() {
+// copy the rest of the black objects and flip
+void sweep_finish() {
+    while (!sweep_step()) {
+    }
+    sweep_cleanup();
+}
+
+// finish the cycle in progress, or run a whole one; grow forces a bigger to-space (within limit)
+static void collect_full(bool grow, size_t limit) {
+    uint64_t pause_start = gc_pause_begin(&gc->pauses);
+    GC_TRACE(GC_TRACE_FULL_GC, GC_TRACE_BEGIN, 0);
+    if (gc->phase == SWEEP) {
+        // to-space is full, the flip may leave enough room in it
+        sweep_finish();
+        GC_TRACE(GC_TRACE_FULL_GC, GC_TRACE_END, 0);
+        gc_pause_end(&gc->pauses, GC_PAUSE_FULL, pause_start);
+        return;
+    }
     bool done = mark_step();
     while (!done) {
         done = mark_step();
     }
-    gc->phase = SWEEP;
-    gc->stats.sweep_phase_count += 1;
-    sweep_prepare(true); // allocate new space
-    done = sweep_step();
-    while (!done) {
-        done = sweep_step();
+    // sized like an incremental cycle, but a full collection copies however empty the heap is
+    SWEEP_STRATEGY strategy = grow ? MAKE_BIGGER : sweep_strategy();
+    strategy = strategy == DO_NOTHING ? KEEP_SIZE : strategy;
+    if (sweep_prepare(strategy, limit) != DO_NOTHING) {
+        GC_TRACE(GC_TRACE_MARK_PHASE, GC_TRACE_END, 0);
+        GC_TRACE(GC_TRACE_SWEEP_PHASE, GC_TRACE_BEGIN, 0);
+        gc_mutators_retire_tlabs();
+        gc->phase = SWEEP;
+        gc->stats.sweep_phase_count += 1;
+        sweep_finish();
     }
-    sweep_cleanup();
+    GC_TRACE(GC_TRACE_FULL_GC, GC_TRACE_END, 0);
+    gc_pause_end(&gc->pauses, GC_PAUSE_FULL, pause_start);
+}
+
+void gc_full() {
+    collect_full(false, growth_limit(false));
+}
+
+bool gc_collect_for(int attempt) {
+    // the heap doubles up to the soft limit, where the collection compacts it instead; only when
+    // that was not enough it grows further, up to the hard limit
+    const size_t heap_size = gc->current_heap_size;
+    collect_full(true, growth_limit(attempt > 0));
+    return attempt == 0 || gc->current_heap_size > heap_size;
+}
+
+void gc_out_of_memory(size_t size_in_bytes) {
+    if (gc->oom_handler != NULL) {
+        gc->oom_handler(size_in_bytes, gc->oom_data);
+    }
+    printf("Out of memory: %lu bytes requested, the heap is %lu bytes", (unsigned long) size_in_bytes,
+           (unsigned long) gc->current_heap_size);
+    if (gc->hard_heap_limit != 0) {
+        printf(" (limit %lu bytes)", (unsigned long) gc->hard_heap_limit);
+    }
+    printf("\n");
+    exit(1);
+}
+
+void gc_set_oom_handler(gc_oom_handler_t handler, void *data) {
+    gc_init();
+    gc->oom_handler = handler;
+    gc->oom_data = data;
+}
+
+bool gc_set_heap_limits(size_t soft_limit, size_t hard_limit) {
+    gc_init();
+    if (soft_limit > GC_MAX_HEAP_SIZE || hard_limit > GC_MAX_HEAP_SIZE) {
+        printf("Heap limit is over the largest heap of %lu bytes\n", (unsigned long) GC_MAX_HEAP_SIZE);
+        return false;
+    }
+    if (hard_limit != 0 && soft_limit > hard_limit) {
+        printf("Soft heap limit %lu is over the hard limit %lu\n", (unsigned long) soft_limit,
+               (unsigned long) hard_limit);
+        return false;
+    }
+    gc->soft_heap_limit = soft_limit;
+    gc->hard_heap_limit = hard_limit;
+    return true;
 }
 
 void gc_step() {
+    uint64_t pause_start = gc_pause_begin(&gc->pauses);
+    GC_TRACE(GC_TRACE_STEP, GC_TRACE_BEGIN, gc->phase);
     if (gc->phase == MARK) {
         const bool is_done = mark_step();
         if (is_done) {
-            const SWEEP_STRATEGY strategy = sweep_prepare(false);
+            const SWEEP_STRATEGY strategy = sweep_prepare(sweep_strategy(), growth_limit(false));
             if (strategy != DO_NOTHING) {
+                GC_TRACE(GC_TRACE_MARK_PHASE, GC_TRACE_END, 0);
+                // TLABs in from-space end here, new objects go to to-space
+                gc_mutators_retire_tlabs();
                 gc->phase = SWEEP;
                 gc->stats.sweep_phase_count += 1;
+                GC_TRACE(GC_TRACE_SWEEP_PHASE, GC_TRACE_BEGIN, 0);
             }
         }
     } else {
@@ -596,5 +1328,10 @@ void gc_step() {
             sweep_cleanup();
         }
     }
+    GC_TRACE(GC_TRACE_STEP, GC_TRACE_END, gc->phase);
+    gc_pause_end(&gc->pauses, GC_PAUSE_STEP, pause_start);
+    if (gc->shm != NULL) {
+        gc_publish_shm_stats();
+    }
     fflush(stdout);
 }
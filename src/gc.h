@@ -3,6 +3,10 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdbool.h>
+
+#include "gc_pause.h"
+#include "gc_record.h"
 
 /** This macro is used whenever the runtime wants to READ a heap object's field.
  */
@@ -11,6 +15,11 @@
  * This is NOT used when initializing object fields.
  */
 #define GC_WRITE_BARRIER(object, field_index, contents, write_code) (gc_write_barrier(object, field_index, contents), write_code) // NO BARRIER
+/** This macro is used whenever the runtime INITIALIZES a field of a freshly allocated object.
+ * init_code is an assignment, its value (the stored contents) is only recorded while
+ * allocations are recorded (see gc_record.h). init_code is evaluated exactly once.
+ */
+#define GC_INIT_BARRIER(object, field_index, init_code) (gc_record_enabled ? gc_record_init(object, field_index, init_code) : (void)(init_code))
 
 /** Allocate an object on the heap of AT LEAST size_in_bytes bytes.
  * If necessary, this should start/continue garbage collection.
@@ -18,6 +27,21 @@
  */
 void* gc_alloc(size_t size_in_bytes_for_stella);
 
+/** Allocate count objects of size_in_bytes_for_stella bytes each in one reservation, with one
+ * collector step (site as in gc_alloc_at_site, see gc_pretenure.h; bulk objects are never pretenured).
+ * Returns the first object, the others follow it gc_bulk_stride(size_in_bytes_for_stella) bytes apart.
+ * Their fields count is set; tags and all fields must be initialised before the next allocation.
+ */
+void *gc_alloc_bulk(size_t size_in_bytes_for_stella, int count, int site);
+
+/** Distance between consecutive objects of a gc_alloc_bulk reservation. */
+size_t gc_bulk_stride(size_t size_in_bytes_for_stella);
+
+/** Notify the GC that a freshly allocated object has its header (tag and fields count) initialised.
+ * Used for per-tag allocation profiling.
+ */
+void gc_object_allocated(void *object);
+
 /** GC-specific code which must be executed on each READ operation.
  */
 void gc_read_barrier(void *object, int field_index);
@@ -44,6 +68,88 @@ void gc_pop_root(void **object);
  */
 void print_gc_alloc_stats();
 
+/** Snapshot of GC statistics. Residency is measured at every flip (end of sweep phase). */
+typedef struct gc_stats_snapshot_t {
+    unsigned long total_allocated_bytes;
+    unsigned long total_allocated_objects;
+
+    unsigned long max_residency_bytes;      /**< Peak live bytes observed after a flip. */
+    unsigned long max_residency_objects;    /**< Peak live objects observed after a flip. */
+    unsigned long last_residency_bytes;     /**< Live bytes after the last flip. */
+    unsigned long last_residency_objects;   /**< Live objects after the last flip. */
+
+    unsigned long current_allocated_bytes;  /**< Allocated since the last flip. */
+    unsigned long current_allocated_objects;
+
+    unsigned long total_reads;
+    unsigned long total_writes;
+
+    unsigned long gc_roots_max_size;
+
+    unsigned long mark_steps;
+    unsigned long sweep_steps;
+    unsigned long mark_phase_count;
+    unsigned long sweep_phase_count;
+    unsigned long marked_objects;
+
+    unsigned long heap_size;
+    int phase;                              /**< 0 is mark, 1 is sweep. */
+
+    gc_pause_stats_t pauses;
+} gc_stats_snapshot_t;
+
+typedef enum GC_STATS_FORMAT {
+    GC_STATS_JSON,
+    GC_STATS_CSV,
+} GC_STATS_FORMAT;
+
+/** Fill stats with the current GC statistics.
+ */
+void gc_get_stats(gc_stats_snapshot_t *stats);
+
+/** Write a statistics snapshot to a file descriptor as a JSON object
+ * or as a two-line CSV (header and values). Returns false on write error.
+ */
+bool gc_export_stats(int fd, GC_STATS_FORMAT format);
+
+/** If STELLA_GC_STATS_FILE=<file> is set, export statistics to <file> at exit.
+ * The format is JSON unless STELLA_GC_STATS_FORMAT=csv.
+ */
+void gc_stats_configure_from_env();
+
+/** Called when an allocation of size_in_bytes cannot be satisfied: full collections did not free
+ * enough and the heap cannot grow (hard limit reached or no memory). No collection is in
+ * progress then, so the handler may longjmp out of the evaluation which allocated; running each
+ * evaluation on a root stack of its own (see gc_roots.h) lets the host drop the roots it pushed.
+ * If the handler returns, or none is set, the program prints a message and exits.
+ */
+typedef void (*gc_oom_handler_t)(size_t size_in_bytes, void *data);
+
+/** Set the out-of-memory handler of the calling thread's context (NULL for none). */
+void gc_set_oom_handler(gc_oom_handler_t handler, void *data);
+
+/** Limit the heap of the calling thread's context, in bytes of one semispace (heap_size in
+ * gc_stats_snapshot_t; copying needs a second one). 0 means no limit, which is the default.
+ * Past the soft limit the heap only grows when an allocation still fails after full collections,
+ * and it shrinks back as soon as live data allows. It never grows past the hard limit: an
+ * allocation which does not fit then goes to the out-of-memory handler, as it does without a
+ * hard limit once the heap reaches the 32 GB covered by forwarding references. Returns false
+ * (keeping the old limits) if a limit is over 32 GB or the soft one is over the hard one.
+ * STELLA_GC_SOFT_HEAP_LIMIT and STELLA_GC_HEAP_LIMIT=<bytes>[K|M|G] set them for new contexts.
+ */
+bool gc_set_heap_limits(size_t soft_limit, size_t hard_limit);
+
+/** Order in which the copying phase evacuates live objects. */
+typedef enum GC_COPY_ORDER {
+    GC_COPY_CHASE,          /**< Marking order, each copy followed by the chain through its last uncopied field (default). */
+    GC_COPY_DEPTH_FIRST,    /**< Depth-first along the first field in page-sized groups, children next to their parent. */
+} GC_COPY_ORDER;
+
+/** Set the copy order of the calling thread's context.
+ * STELLA_GC_COPY_ORDER=chase|depth-first sets the default for new contexts.
+ */
+void gc_set_copy_order(GC_COPY_ORDER order);
+
 /** Print GC state. Output must include at least:
  *
  * 1. Heap state.
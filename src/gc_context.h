@@ -0,0 +1,61 @@
+#ifndef STELLA_GC_CONTEXT_H
+#define STELLA_GC_CONTEXT_H
+
+/** An independent GC heap with its own roots, statistics and profiles.
+ *
+ * Every thread works with the context bound to it: gc_alloc, the barriers, the root
+ * stack and the statistics functions all operate on that context. Contexts share no
+ * state, so evaluations on different threads need no synchronisation. A context must
+ * only be bound (gc_context_bind) to one thread at a time, more threads can share its
+ * heap with gc_context_attach.
+ *
+ * If a thread uses the GC without binding a context, one is created on first use
+ * (see gc_init). Environment settings (STELLA_GC_TRACE, STELLA_GC_STATS_FILE, ...)
+ * only apply to the first context created that way in the process.
+ */
+typedef struct gc_t gc_context_t;
+
+/** Create a context with an empty heap. The context is not bound to any thread. */
+gc_context_t *gc_context_create();
+
+/** Free the heap and everything owned by a context. If it is bound to the calling
+ * thread, the thread is left without a context. Objects of the context must not be used afterwards.
+ */
+void gc_context_destroy(gc_context_t *context);
+
+/** Bind a context (or NULL) to the calling thread. Returns the previously bound context. */
+gc_context_t *gc_context_bind(gc_context_t *context);
+
+/** Context bound to the calling thread, NULL if there is none. */
+gc_context_t *gc_context_current();
+
+/** Bind a new context to the calling thread unless it already has one. */
+void gc_init();
+
+/** Run Stella code on the calling thread with the heap of a context that other threads use too.
+ * The thread gets its own root stack and allocation buffer. Any context bound to the thread is unbound.
+ *
+ * While more than one thread uses a context, collector work is done with all of them stopped
+ * at safepoints: gc_alloc and gc_safepoint, where only rooted
+ * pointers stay valid. A thread which waits for something
+ * else (a lock, a join, I/O) must do it between gc_blocking_begin and gc_blocking_end, or the
+ * other threads wait for it at their next collection. A thread must detach before it exits,
+ * and all threads must detach before the context is destroyed.
+ */
+void gc_context_attach(gc_context_t *context);
+
+/** Stop using the context the calling thread attached to (or is bound to). Its roots must have been popped. */
+void gc_context_detach();
+
+/** Stop here if the collector waits for this thread, for long loops which do not allocate.
+ * Objects may move, as in gc_alloc.
+ */
+void gc_safepoint();
+
+/** The calling thread does not touch Stella objects until gc_blocking_end, collections may run meanwhile. */
+void gc_blocking_begin();
+
+/** Wait for a running collection to finish and continue running Stella code. */
+void gc_blocking_end();
+
+#endif
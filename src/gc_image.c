@@ -0,0 +1,360 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gc.h"
+#include "gc_internal.h"
+#include "gc_image.h"
+
+// external pointers are stored relative to this object
+#define IMAGE_ANCHOR ((char *) &the_ZERO)
+
+static void image_anchor_checks(int64_t checks[2]) {
+    checks[0] = (char *) &the_UNIT - IMAGE_ANCHOR;
+    checks[1] = (char *) (void *) gc_alloc - IMAGE_ANCHOR;
+}
+
+bool gc_is_in_image(void *ptr) {
+    for (int i = 0; i < gc->images_count; i++) {
+        if (ptr >= gc->images[i].objects && ptr < gc->images[i].objects + gc->images[i].objects_size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool is_object(void *ptr) {
+    return is_in_current_heap(ptr) || (gc->phase == SWEEP && is_in_next_heap(ptr)) || gc_is_in_mature(ptr)
+           || gc_is_in_image(ptr);
+}
+
+// while copying, an object and its copy are one object for the image
+static gc_object_t *canonical_object(void *ptr) {
+    gc_object_t *gc_obj = stella_object_to_gc_object(ptr);
+    if (gc->phase == SWEEP && is_in_current_heap(ptr) && gc_obj->forward != 0) {
+        return gc_forwarded(gc_obj);
+    }
+    return gc_obj;
+}
+
+static uint64_t encode(GC_IMAGE_KIND kind, int64_t value) {
+    return ((uint64_t) value << 2) | kind;
+}
+
+typedef struct image_writer_t {
+    // object -> offset of its Stella object in the image
+    gc_weak_map_t offsets;
+    gc_object_t **objects;
+    size_t objects_count;
+    size_t objects_capacity;
+    uint64_t size;
+} image_writer_t;
+
+static void add_object(image_writer_t *writer, void *ptr) {
+    gc_object_t *gc_obj = canonical_object(ptr);
+    uint64_t offset;
+    if (gc_weak_map_get(&writer->offsets, gc_obj, &offset)) {
+        return;
+    }
+    if (writer->objects_count == writer->objects_capacity) {
+        size_t capacity = writer->objects_capacity == 0 ? 1024 : writer->objects_capacity * 2;
+        gc_object_t **objects = realloc(writer->objects, capacity * sizeof(gc_object_t *));
+        if (objects == NULL) {
+            printf("Memory allocation for heap image failed!\n");
+            exit(1);
+        }
+        writer->objects = objects;
+        writer->objects_capacity = capacity;
+    }
+    writer->objects[writer->objects_count++] = gc_obj;
+    gc_weak_map_put(&writer->offsets, gc_obj, writer->size + (sizeof(gc_object_t) - sizeof(stella_object)));
+    writer->size += get_gc_object_size(gc_obj);
+}
+
+static uint64_t encode_value(image_writer_t *writer, void *value) {
+    if (value == NULL) {
+        return encode(GC_IMAGE_NULL, 0);
+    }
+    if (is_object(value)) {
+        uint64_t offset;
+        gc_weak_map_get(&writer->offsets, canonical_object(value), &offset);
+        return encode(GC_IMAGE_INTERNAL, offset);
+    }
+    return encode(GC_IMAGE_EXTERNAL, (char *) value - IMAGE_ANCHOR);
+}
+
+static bool write_image(image_writer_t *writer, FILE *out, void **roots, int roots_count) {
+    gc_image_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GC_IMAGE_MAGIC, sizeof(header.magic));
+    header.version = GC_IMAGE_VERSION;
+    header.pointer_size = sizeof(void *);
+    image_anchor_checks(header.anchor_checks);
+    header.objects_size = writer->size;
+    header.roots_count = roots_count;
+    fwrite(&header, sizeof(header), 1, out);
+
+    gc_object_t *buffer = malloc(sizeof(gc_object_t) + 15 * sizeof(void *));
+    if (buffer == NULL) {
+        printf("Memory allocation for heap image failed!\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < writer->objects_count; i++) {
+        gc_object_t *gc_obj = writer->objects[i];
+        const int fields_count = STELLA_OBJECT_HEADER_FIELD_COUNT(gc_obj->obj.object_header);
+        const int pointers_count = STELLA_OBJECT_HEADER_POINTER_COUNT(gc_obj->obj.object_header);
+        memset(buffer, 0, sizeof(gc_object_t));
+        buffer->color = BLACK;
+        buffer->age = gc_obj->age;
+        buffer->flags = GC_OBJECT_IMMORTAL;
+        buffer->forward = 0;
+        buffer->obj.object_header = gc_obj->obj.object_header;
+        // raw fields (limbs of naturals) are written as they are
+        memcpy(buffer->obj.object_fields, gc_obj->obj.object_fields, fields_count * sizeof(void *));
+        for (int j = 0; j < pointers_count; j++) {
+            uint64_t field = encode_value(writer, gc_obj->obj.object_fields[j]);
+            memcpy(&buffer->obj.object_fields[j], &field, sizeof(field));
+        }
+        fwrite(buffer, get_gc_object_size(gc_obj), 1, out);
+    }
+    free(buffer);
+    for (int i = 0; i < roots_count; i++) {
+        uint64_t root = encode_value(writer, roots[i]);
+        fwrite(&root, sizeof(root), 1, out);
+    }
+    return !ferror(out);
+}
+
+bool gc_save_image(const char *path, void **roots, int roots_count) {
+    gc_init();
+    FILE *out = fopen(path, "wb");
+    if (out == NULL) {
+        printf("Failed to open heap image file %s\n", path);
+        return false;
+    }
+    gc_safepoint_begin();
+    image_writer_t writer;
+    memset(&writer, 0, sizeof(writer));
+    gc_weak_map_init(&writer.offsets, NULL, NULL, NULL);
+    for (int i = 0; i < roots_count; i++) {
+        if (is_object(roots[i])) {
+            add_object(&writer, roots[i]);
+        }
+    }
+    // breadth first, the objects array doubles as the queue
+    for (size_t i = 0; i < writer.objects_count; i++) {
+        gc_object_t *gc_obj = writer.objects[i];
+        const int fields_count = STELLA_OBJECT_HEADER_POINTER_COUNT(gc_obj->obj.object_header);
+        for (int j = 0; j < fields_count; j++) {
+            if (is_object(gc_obj->obj.object_fields[j])) {
+                add_object(&writer, gc_obj->obj.object_fields[j]);
+            }
+        }
+    }
+    bool ok = write_image(&writer, out, roots, roots_count);
+    gc_safepoint_end();
+    gc_weak_map_free(&writer.offsets);
+    free(writer.objects);
+    return fclose(out) == 0 && ok;
+}
+
+static bool decode(uint64_t word, void *objects, size_t objects_size, void **value) {
+    const int64_t payload = (int64_t) word >> 2;
+    switch (word & 3) {
+        case GC_IMAGE_NULL:
+            *value = NULL;
+            return true;
+        case GC_IMAGE_INTERNAL:
+            if (payload < 0 || (uint64_t) payload >= objects_size) {
+                return false;
+            }
+            *value = objects + payload;
+            return true;
+        case GC_IMAGE_EXTERNAL:
+            *value = IMAGE_ANCHOR + payload;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// turn encoded fields into pointers, false if the image is malformed
+static bool relocate(void *objects, size_t objects_size, uint64_t *roots, int roots_count, void **root_values) {
+    void *end = objects + objects_size;
+    for (void *p = objects; p < end; p += get_gc_object_size(p)) {
+        gc_object_t *gc_obj = p;
+        if ((size_t) (end - p) < sizeof(gc_object_t) || (size_t) (end - p) < get_gc_object_size(gc_obj)) {
+            return false;
+        }
+        const int fields_count = STELLA_OBJECT_HEADER_POINTER_COUNT(gc_obj->obj.object_header);
+        for (int i = 0; i < fields_count; i++) {
+            uint64_t field;
+            memcpy(&field, &gc_obj->obj.object_fields[i], sizeof(field));
+            if (!decode(field, objects, objects_size, &gc_obj->obj.object_fields[i])) {
+                return false;
+            }
+        }
+    }
+    for (int i = 0; i < roots_count; i++) {
+        if (!decode(roots[i], objects, objects_size, &root_values[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool gc_add_image_region(const gc_image_region_t *region) {
+    gc_safepoint_begin();
+    if (gc->images_count == GC_MAX_IMAGES) {
+        gc_safepoint_end();
+        printf("Too many heap images loaded\n");
+        return false;
+    }
+    gc->images[gc->images_count++] = *region;
+    gc_safepoint_end();
+    return true;
+}
+
+bool gc_load_image(const char *path, void **roots, int roots_count) {
+    gc_init();
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(gc_image_header_t)) {
+        printf("%s is not a heap image\n", path);
+        close(fd);
+        return false;
+    }
+    // private writable mapping: relocation and later writes only copy the pages they touch
+    void *mapping = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        printf("Failed to map heap image %s\n", path);
+        return false;
+    }
+    gc_image_header_t *header = mapping;
+    int64_t anchor_checks[2];
+    image_anchor_checks(anchor_checks);
+    if (memcmp(header->magic, GC_IMAGE_MAGIC, sizeof(header->magic)) != 0 || header->version != GC_IMAGE_VERSION
+        || header->pointer_size != sizeof(void *)
+        || header->objects_size > (uint64_t) st.st_size
+        || sizeof(gc_image_header_t) + header->objects_size + header->roots_count * sizeof(uint64_t) != (uint64_t) st.st_size) {
+        printf("%s is not a heap image\n", path);
+        munmap(mapping, st.st_size);
+        return false;
+    }
+    if (memcmp(header->anchor_checks, anchor_checks, sizeof(anchor_checks)) != 0) {
+        printf("Heap image %s was saved by another executable\n", path);
+        munmap(mapping, st.st_size);
+        return false;
+    }
+    if (header->roots_count != (uint64_t) roots_count) {
+        printf("Heap image %s has %lu roots, %d expected\n", path, (unsigned long) header->roots_count, roots_count);
+        munmap(mapping, st.st_size);
+        return false;
+    }
+    void *objects = mapping + sizeof(gc_image_header_t);
+    void **root_values = malloc((roots_count > 0 ? roots_count : 1) * sizeof(void *));
+    if (root_values == NULL) {
+        printf("Memory allocation for heap image failed!\n");
+        exit(1);
+    }
+    if (!relocate(objects, header->objects_size, objects + header->objects_size, roots_count, root_values)) {
+        printf("Heap image %s is corrupted\n", path);
+        free(root_values);
+        munmap(mapping, st.st_size);
+        return false;
+    }
+    const gc_image_region_t region = {
+        .mapping = mapping,
+        .mapping_size = st.st_size,
+        .objects = objects,
+        .objects_size = header->objects_size,
+    };
+    if (!gc_add_image_region(&region)) {
+        free(root_values);
+        munmap(mapping, st.st_size);
+        return false;
+    }
+    memcpy(roots, root_values, roots_count * sizeof(void *));
+    free(root_values);
+    return true;
+}
+
+void gc_images_free() {
+    for (int i = 0; i < gc->images_count; i++) {
+        munmap(gc->images[i].mapping, gc->images[i].mapping_size);
+    }
+    gc->images_count = 0;
+    free(gc->remembered);
+    gc->remembered = NULL;
+    gc->remembered_count = 0;
+    gc->remembered_capacity = 0;
+}
+
+static void remember(gc_object_t *gc_obj) {
+    if (gc->remembered_count == gc->remembered_capacity) {
+        size_t capacity = gc->remembered_capacity == 0 ? 64 : gc->remembered_capacity * 2;
+        gc_object_t **remembered = realloc(gc->remembered, capacity * sizeof(gc_object_t *));
+        if (remembered == NULL) {
+            printf("Memory allocation for remembered set failed!\n");
+            exit(1);
+        }
+        gc->remembered = remembered;
+        gc->remembered_capacity = capacity;
+    }
+    gc_obj->flags |= GC_OBJECT_REMEMBERED;
+    gc->remembered[gc->remembered_count++] = gc_obj;
+}
+
+void gc_remember_image_write(void *object, void *contents) {
+    gc_object_t *gc_obj = stella_object_to_gc_object(object);
+    if (!(is_in_current_heap(contents) || is_in_next_heap(contents) || gc_is_in_mature(contents))) {
+        return;
+    }
+    if (gc_is_shared()) {
+        pthread_mutex_lock(&gc->lock);
+        if (!(gc_obj->flags & GC_OBJECT_REMEMBERED)) {
+            remember(gc_obj);
+        }
+        pthread_mutex_unlock(&gc->lock);
+    } else if (!(gc_obj->flags & GC_OBJECT_REMEMBERED)) {
+        remember(gc_obj);
+    }
+}
+
+void mark_remembered_set() {
+    for (size_t i = 0; i < gc->remembered_count; i++) {
+        gc_object_t *gc_obj = gc->remembered[i];
+        const int fields_count = STELLA_OBJECT_HEADER_POINTER_COUNT(gc_obj->obj.object_header);
+        for (int j = 0; j < fields_count; j++) {
+            make_stella_object_grey_if_needed(gc_obj->obj.object_fields[j]);
+        }
+    }
+}
+
+void sweep_remembered_set() {
+    size_t kept = 0;
+    for (size_t i = 0; i < gc->remembered_count; i++) {
+        gc_object_t *gc_obj = gc->remembered[i];
+        const int fields_count = STELLA_OBJECT_HEADER_POINTER_COUNT(gc_obj->obj.object_header);
+        bool refers_to_heap = false;
+        for (int j = 0; j < fields_count; j++) {
+            gc_obj->obj.object_fields[j] = sweep_forward(gc_obj->obj.object_fields[j]);
+            void *field = gc_obj->obj.object_fields[j];
+            refers_to_heap = refers_to_heap || is_in_next_heap(field) || gc_is_in_mature(field);
+        }
+        if (refers_to_heap) {
+            gc->remembered[kept++] = gc_obj;
+        } else {
+            gc_obj->flags &= ~GC_OBJECT_REMEMBERED;
+        }
+    }
+    gc->remembered_count = kept;
+}
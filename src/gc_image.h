@@ -0,0 +1,53 @@
+#ifndef STELLA_GC_IMAGE_H
+#define STELLA_GC_IMAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Heap image file layout (native byte order):
+ *
+ *   gc_image_header_t
+ *   objects_size bytes: objects with GC headers, as laid out in the heap
+ *   roots_count times: uint64_t encoded root value
+ *
+ * Every field and root is encoded as (value << 2) | kind, value being the offset of a Stella
+ * object from the start of the objects for GC_IMAGE_INTERNAL and the distance from the_ZERO
+ * for GC_IMAGE_EXTERNAL (static objects and code), so the image does not depend on where
+ * it is mapped. It does depend on the executable: only the program which saved an image
+ * (statically linked with the runtime) can load it.
+ */
+#define GC_IMAGE_MAGIC "SGCIMAGE"
+#define GC_IMAGE_VERSION 2
+
+typedef enum GC_IMAGE_KIND {
+    GC_IMAGE_NULL,
+    GC_IMAGE_INTERNAL,
+    GC_IMAGE_EXTERNAL,
+} GC_IMAGE_KIND;
+
+typedef struct gc_image_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t pointer_size;
+    /** Distances between runtime symbols, an image built by another executable is rejected. */
+    int64_t anchor_checks[2];
+    uint64_t objects_size;
+    uint64_t roots_count;
+} gc_image_header_t;
+
+/** Save every object reachable from roots[0 .. roots_count) into an image file at path.
+ * Returns false on I/O error.
+ */
+bool gc_save_image(const char *path, void **roots, int roots_count);
+
+/** Map an image saved by gc_save_image and store its roots into roots[0 .. roots_count).
+ *
+ * The objects are mapped copy-on-write and become immortal: like static objects they are
+ * never copied or freed. Heap objects stored into them are kept alive through a remembered
+ * set. Returns false (leaving roots untouched) if the file is missing, malformed, saved by
+ * another executable or has a different number of roots, so callers can fall back to building
+ * the structures and saving an image for the next run.
+ */
+bool gc_load_image(const char *path, void **roots, int roots_count);
+
+#endif
@@ -0,0 +1,489 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "runtime.h"
+#include "gc_internal.h"
+#include "gc_input.h"
+
+// a value whose parts are still to be written or built
+typedef struct input_frame_t {
+    stella_object *obj;
+    int index;
+} input_frame_t;
+
+typedef struct input_stack_t {
+    input_frame_t *frames;
+    int depth;
+    int capacity;
+} input_stack_t;
+
+static void stack_push(input_stack_t *stack, input_frame_t frame) {
+    if (stack->depth == stack->capacity) {
+        int capacity = stack->capacity == 0 ? 64 : stack->capacity * 2;
+        input_frame_t *frames = realloc(stack->frames, capacity * sizeof(input_frame_t));
+        if (frames == NULL) {
+            printf("Memory allocation for input failed!\n");
+            exit(1);
+        }
+        stack->frames = frames;
+        stack->capacity = capacity;
+    }
+    stack->frames[stack->depth++] = frame;
+}
+
+static void write_varint(FILE *out, uint64_t value) {
+    unsigned char bytes[10];
+    int count = 0;
+    do {
+        bytes[count] = value & 0x7f;
+        value >>= 7;
+        bytes[count++] |= value != 0 ? 0x80 : 0;
+    } while (value != 0);
+    fwrite(bytes, 1, count, out);
+}
+
+// fields are read directly: the read barrier only counts the program's reads;
+// false if succs carry the natural past STELLA_NAT_MAX_LIMBS, which the loader would refuse
+static bool write_nat(FILE *out, stella_object *n) {
+    uint64_t limbs[STELLA_NAT_MAX_LIMBS + 1] = {0};
+    uint64_t succs = 0;
+    int count = 0;
+    while (STELLA_OBJECT_HEADER_TAG(n->object_header) == TAG_SUCC) {
+        n = n->object_fields[0];
+        succs += 1;
+    }
+    if (STELLA_OBJECT_HEADER_TAG(n->object_header) == TAG_NAT) {
+        count = STELLA_OBJECT_HEADER_FIELD_COUNT(n->object_header);
+        memcpy(limbs, n->object_fields, count * sizeof(uint64_t));
+    }
+    for (int i = 0; succs != 0; i++) {
+        limbs[i] += succs;
+        succs = limbs[i] < succs;
+        count = i + 1 > count ? i + 1 : count;
+    }
+    if (count > STELLA_NAT_MAX_LIMBS) {
+        return false;
+    }
+    if (count <= 1) {
+        fputc('n', out);
+        write_varint(out, limbs[0]);
+    } else {
+        fputc('N', out);
+        fputc(count, out);
+        fwrite(limbs, sizeof(uint64_t), count, out);
+    }
+    return true;
+}
+
+static bool write_value(FILE *out, input_stack_t *stack, stella_object *value) {
+    stack->depth = 0;
+    stack_push(stack, (input_frame_t) {value, -1});
+    while (stack->depth > 0) {
+        input_frame_t *top = &stack->frames[stack->depth - 1];
+        stella_object *obj = top->obj, *next = NULL;
+        const int tag = STELLA_OBJECT_HEADER_TAG(obj->object_header);
+        const int fields_count = STELLA_OBJECT_HEADER_FIELD_COUNT(obj->object_header);
+        if (top->index < 0) {
+            top->index = 0;
+            switch (tag) {
+                case TAG_ZERO:
+                case TAG_SUCC:
+                case TAG_NAT:
+                    if (!write_nat(out, obj)) {
+                        return false;
+                    }
+                    break;
+                case TAG_FALSE:
+                    fputc('f', out);
+                    break;
+                case TAG_TRUE:
+                    fputc('t', out);
+                    break;
+                case TAG_UNIT:
+                    fputc('u', out);
+                    break;
+                case TAG_INL:
+                    fputc('l', out);
+                    break;
+                case TAG_INR:
+                    fputc('r', out);
+                    break;
+                case TAG_TUPLE:
+                    fputc('{', out);
+                    fputc(fields_count, out);
+                    break;
+                case TAG_EMPTY:
+                case TAG_CONS: {
+                    uint64_t length = 0;
+                    for (stella_object *cell = obj; STELLA_OBJECT_HEADER_TAG(cell->object_header) == TAG_CONS;
+                         cell = cell->object_fields[1]) {
+                        length += 1;
+                    }
+                    fputc('[', out);
+                    write_varint(out, length);
+                    break;
+                }
+                default:
+                    // functions and references have no meaning outside of the program
+                    return false;
+            }
+        }
+        switch (tag) {
+            case TAG_INL:
+            case TAG_INR:
+            case TAG_TUPLE:
+                if (top->index < (tag == TAG_TUPLE ? fields_count : 1)) {
+                    next = obj->object_fields[top->index++];
+                }
+                break;
+            case TAG_CONS:
+                // the frame moves along the list
+                next = obj->object_fields[0];
+                top->obj = obj->object_fields[1];
+                break;
+        }
+        if (next == NULL) {
+            stack->depth -= 1;
+        } else {
+            stack_push(stack, (input_frame_t) {next, -1});
+        }
+    }
+    return true;
+}
+
+bool gc_save_input(const char *path, void **values, int values_count) {
+    FILE *out = fopen(path, "wb");
+    if (out == NULL) {
+        printf("Failed to open input file %s\n", path);
+        return false;
+    }
+    gc_input_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GC_INPUT_MAGIC, sizeof(header.magic));
+    header.version = GC_INPUT_VERSION;
+    header.values_count = values_count;
+    fwrite(&header, sizeof(header), 1, out);
+    input_stack_t stack = {NULL, 0, 0};
+    bool ok = true;
+    for (int i = 0; ok && i < values_count; i++) {
+        ok = write_value(out, &stack, values[i]);
+    }
+    free(stack.frames);
+    ok = !ferror(out) && ok;
+    return fclose(out) == 0 && ok;
+}
+
+typedef struct input_reader_t {
+    const unsigned char *p;
+    const unsigned char *end;
+} input_reader_t;
+
+static bool read_varint(input_reader_t *in, uint64_t *value) {
+    *value = 0;
+    for (int shift = 0; in->p < in->end && shift < 64; shift += 7) {
+        const unsigned char byte = *in->p++;
+        *value |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static size_t object_size(int fields_count) {
+    return sizeof(gc_object_t) + fields_count * sizeof(void *);
+}
+
+// first pass: check the values and measure the objects they need, nothing is built
+static bool scan(input_reader_t in, uint64_t values_count, size_t *objects_size, uint64_t *chain_length) {
+    // every value takes a byte at least, which bounds the counts read from the file
+    uint64_t expected = values_count;
+    *objects_size = 0;
+    *chain_length = 0;
+    for (; expected > 0; expected--) {
+        if (expected > (uint64_t) (in.end - in.p)) {
+            return false;
+        }
+        uint64_t n;
+        switch (*in.p++) {
+            case 'n':
+                if (!read_varint(&in, &n)) {
+                    return false;
+                }
+                if (n > GC_INPUT_MAX_SUCC_CHAIN) {
+                    *objects_size += object_size(1);
+                } else if (n > *chain_length) {
+                    *chain_length = n;
+                }
+                break;
+            case 'N': {
+                if (in.p == in.end) {
+                    return false;
+                }
+                const int count = *in.p++;
+                if (count < 1 || count > STELLA_NAT_MAX_LIMBS || (size_t) (in.end - in.p) < count * sizeof(uint64_t)) {
+                    return false;
+                }
+                uint64_t highest;
+                memcpy(&highest, in.p + (count - 1) * sizeof(uint64_t), sizeof(highest));
+                if (highest == 0) {
+                    return false;
+                }
+                in.p += count * sizeof(uint64_t);
+                *objects_size += object_size(count);
+                break;
+            }
+            case 'f':
+            case 't':
+            case 'u':
+                break;
+            case 'l':
+            case 'r':
+                *objects_size += object_size(1);
+                expected += 1;
+                break;
+            case '{':
+                if (in.p == in.end || *in.p > 15) {
+                    return false;
+                }
+                n = *in.p++;
+                *objects_size += n > 0 ? object_size(n) : 0;
+                expected += n;
+                break;
+            case '[':
+                if (!read_varint(&in, &n) || n > (uint64_t) (in.end - in.p)) {
+                    return false;
+                }
+                *objects_size += n * object_size(2);
+                expected += n;
+                break;
+            default:
+                return false;
+        }
+    }
+    *objects_size += *chain_length * object_size(1);
+    return in.p == in.end;
+}
+
+typedef struct input_region_t {
+    void *top;
+    void *chain;                // the natural chain_length, smaller ones follow it
+    uint64_t chain_length;
+} input_region_t;
+
+static stella_object *region_alloc(input_region_t *region, int tag, int fields_count) {
+    gc_object_t *obj = region->top;
+    region->top += object_size(fields_count);
+    obj->color = BLACK;
+    obj->flags = GC_OBJECT_IMMORTAL;
+    obj->age = 0;
+    obj->site = 0;
+    obj->forward = 0;
+    obj->obj.object_header = tag | (fields_count << 4);
+    return &obj->obj;
+}
+
+static stella_object *build_nat(input_region_t *region, uint64_t n) {
+    if (n == 0) {
+        return &the_ZERO;
+    }
+    if (n <= region->chain_length) {
+        return region->chain + (region->chain_length - n) * object_size(1) + sizeof(gc_object_t) - sizeof(stella_object);
+    }
+    stella_object *obj = region_alloc(region, TAG_NAT, 1);
+    memcpy(obj->object_fields, &n, sizeof(n));
+    return obj;
+}
+
+// the outermost succ comes first, so that reading a number walks forward through memory
+static void build_chain(input_region_t *region) {
+    region->chain = region->top;
+    for (uint64_t i = 0; i < region->chain_length; i++) {
+        stella_object *succ = region_alloc(region, TAG_SUCC, 1);
+        succ->object_fields[0] = i + 1 < region->chain_length ? (void *) succ + object_size(1) : (void *) &the_ZERO;
+    }
+}
+
+// second pass over checked input: values are built in preorder, a parent before its parts
+static void build(input_reader_t in, input_region_t *region, void **values, int values_count) {
+    // slots still to be filled: remaining of them, step bytes apart
+    typedef struct slots_t {
+        void **slot;
+        uint64_t remaining;
+        size_t step;
+    } slots_t;
+    slots_t initial[64];
+    slots_t *stack = initial;
+    int depth = 0, capacity = 64;
+    stack[depth++] = (slots_t) {values, values_count, sizeof(void *)};
+    while (depth > 0) {
+        slots_t *top = &stack[depth - 1];
+        if (top->remaining == 0) {
+            depth -= 1;
+            continue;
+        }
+        void **slot = top->slot;
+        top->slot = (void *) top->slot + top->step;
+        top->remaining -= 1;
+        slots_t parts = {NULL, 0, sizeof(void *)};
+        uint64_t n;
+        switch (*in.p++) {
+            case 'n':
+                read_varint(&in, &n);
+                *slot = build_nat(region, n);
+                break;
+            case 'N': {
+                const int count = *in.p++;
+                stella_object *obj = region_alloc(region, TAG_NAT, count);
+                memcpy(obj->object_fields, in.p, count * sizeof(uint64_t));
+                in.p += count * sizeof(uint64_t);
+                *slot = obj;
+                break;
+            }
+            case 'f':
+                *slot = &the_FALSE;
+                break;
+            case 't':
+                *slot = &the_TRUE;
+                break;
+            case 'u':
+                *slot = &the_UNIT;
+                break;
+            case 'l':
+            case 'r': {
+                stella_object *obj = region_alloc(region, in.p[-1] == 'l' ? TAG_INL : TAG_INR, 1);
+                *slot = obj;
+                parts = (slots_t) {&obj->object_fields[0], 1, sizeof(void *)};
+                break;
+            }
+            case '{': {
+                n = *in.p++;
+                if (n == 0) {
+                    *slot = &the_EMPTY_TUPLE;
+                    break;
+                }
+                stella_object *obj = region_alloc(region, TAG_TUPLE, n);
+                *slot = obj;
+                parts = (slots_t) {&obj->object_fields[0], n, sizeof(void *)};
+                break;
+            }
+            case '[': {
+                read_varint(&in, &n);
+                if (n == 0) {
+                    *slot = &the_EMPTY;
+                    break;
+                }
+                // the cells go together, heads follow them
+                const size_t stride = object_size(2);
+                stella_object *first = NULL;
+                for (uint64_t i = 0; i < n; i++) {
+                    stella_object *cell = region_alloc(region, TAG_CONS, 2);
+                    cell->object_fields[1] = i + 1 < n ? (void *) cell + stride : (void *) &the_EMPTY;
+                    first = first == NULL ? cell : first;
+                }
+                *slot = first;
+                parts = (slots_t) {&first->object_fields[0], n, stride};
+                break;
+            }
+        }
+        if (parts.remaining == 0) {
+            continue;
+        }
+        if (depth == capacity) {
+            slots_t *grown = malloc(2 * capacity * sizeof(slots_t));
+            if (grown == NULL) {
+                printf("Memory allocation for input failed!\n");
+                exit(1);
+            }
+            memcpy(grown, stack, depth * sizeof(slots_t));
+            if (stack != initial) {
+                free(stack);
+            }
+            stack = grown;
+            capacity *= 2;
+        }
+        stack[depth++] = parts;
+    }
+    if (stack != initial) {
+        free(stack);
+    }
+}
+
+bool gc_load_input(const char *path, void **values, int values_count) {
+    gc_init();
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(gc_input_header_t)) {
+        printf("%s is not an input file\n", path);
+        close(fd);
+        return false;
+    }
+    const unsigned char *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        printf("Failed to map input file %s\n", path);
+        return false;
+    }
+    // both passes read the file front to back
+    madvise((void *) mapping, st.st_size, MADV_SEQUENTIAL);
+    gc_input_header_t header;
+    memcpy(&header, mapping, sizeof(header));
+    input_reader_t in = {mapping + sizeof(header), mapping + st.st_size};
+    size_t objects_size;
+    uint64_t chain_length;
+    if (memcmp(header.magic, GC_INPUT_MAGIC, sizeof(header.magic)) != 0 || header.version != GC_INPUT_VERSION
+        || !scan(in, header.values_count, &objects_size, &chain_length)) {
+        printf("%s is not an input file\n", path);
+        munmap((void *) mapping, st.st_size);
+        return false;
+    }
+    if (header.values_count != (uint32_t) values_count) {
+        printf("Input file %s has %u values, %d expected\n", path, header.values_count, values_count);
+        munmap((void *) mapping, st.st_size);
+        return false;
+    }
+    void *objects = NULL;
+    if (objects_size > 0) {
+        // every page is written right away, faulting them in one go is cheaper
+        objects = mmap(NULL, objects_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (objects == MAP_FAILED) {
+            printf("Memory allocation for input failed!\n");
+            exit(1);
+        }
+    }
+    void **built = malloc((values_count > 0 ? values_count : 1) * sizeof(void *));
+    if (built == NULL) {
+        printf("Memory allocation for input failed!\n");
+        exit(1);
+    }
+    input_region_t region = {objects, NULL, chain_length};
+    build_chain(&region);
+    build(in, &region, built, values_count);
+    munmap((void *) mapping, st.st_size);
+    if (objects != NULL) {
+        // values are immutable, stray writes fault instead of going unnoticed by the collector
+        mprotect(objects, objects_size, PROT_READ);
+        const gc_image_region_t image = {
+            .mapping = objects,
+            .mapping_size = objects_size,
+            .objects = objects,
+            .objects_size = objects_size,
+        };
+        if (!gc_add_image_region(&image)) {
+            free(built);
+            munmap(objects, objects_size);
+            return false;
+        }
+    }
+    memcpy(values, built, values_count * sizeof(void *));
+    free(built);
+    return true;
+}
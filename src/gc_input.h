@@ -0,0 +1,53 @@
+#ifndef STELLA_GC_INPUT_H
+#define STELLA_GC_INPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Binary input file layout:
+ *
+ *   gc_input_header_t
+ *   values_count values in preorder
+ *
+ * Every value is one kind byte followed by its payload and then its parts:
+ *
+ *   'n' varint            natural number
+ *   'N' byte c, c limbs   natural number of c 64-bit limbs, lowest first (native byte order)
+ *   'f' 't' 'u'           false, true, unit
+ *   'l' value, 'r' value  inl, inr
+ *   '{' byte k, k values  tuple of at most 15 fields
+ *   '[' varint k, k values list
+ *
+ * varints are unsigned LEB128: 7 bits per byte, lowest first, the high bit set on all bytes
+ * but the last. Nothing in the format refers to addresses, so any program can read any file.
+ */
+#define GC_INPUT_MAGIC "SVALUES\n"
+#define GC_INPUT_VERSION 1
+
+/** Naturals up to this are succ chains, all of them suffixes of one shared chain; larger ones are
+ * binary naturals (TAG_NAT, see stella_nat_add).
+ */
+#define GC_INPUT_MAX_SUCC_CHAIN 65536
+
+typedef struct gc_input_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t values_count;
+} gc_input_header_t;
+
+/** Write values[0 .. values_count) into an input file at path.
+ * Returns false on I/O error, if a value holds functions or references, or if a natural needs
+ * more than STELLA_NAT_MAX_LIMBS limbs (succs on top of a binary natural can carry it past them).
+ */
+bool gc_save_input(const char *path, void **values, int values_count);
+
+/** Map an input file and store its values into values[0 .. values_count).
+ *
+ * Objects are built straight into one read-only region which is registered like a heap image
+ * (and counts as one towards their limit): they are immortal, never copied or scanned, and
+ * loading them does not allocate on the heap or run the collector. Returns false (leaving
+ * values untouched) if the file is missing, malformed or has a different number of values.
+ */
+bool gc_load_input(const char *path, void **values, int values_count);
+
+#endif
@@ -0,0 +1,174 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "gc_internal.h"
+#include "gc_intern.h"
+
+#define INTERN_TABLE_MIN_CAPACITY 256
+
+void gc_intern_table_init(gc_intern_table_t *table) {
+    memset(table, 0, sizeof(gc_intern_table_t));
+}
+
+void gc_intern_table_free(gc_intern_table_t *table) {
+    free(table->entries);
+    table->entries = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
+
+static bool is_internable(const stella_object *object) {
+    switch (STELLA_OBJECT_HEADER_TAG(object->object_header)) {
+        case TAG_SUCC:
+        case TAG_INL:
+        case TAG_INR:
+        case TAG_CONS:
+        case TAG_TUPLE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// fields are compared by address, so the hash changes whenever a field moves
+static size_t hash_object(const stella_object *object, size_t capacity) {
+    uint64_t h = (uint64_t) (unsigned) object->object_header * 0x9e3779b97f4a7c15ull;
+    const int fields_count = STELLA_OBJECT_HEADER_FIELD_COUNT(object->object_header);
+    for (int i = 0; i < fields_count; i++) {
+        h = (h ^ (uint64_t) (uintptr_t) object->object_fields[i]) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    return h & (capacity - 1);
+}
+
+static bool objects_equal(const stella_object *a, const stella_object *b) {
+    if (a->object_header != b->object_header) {
+        return false;
+    }
+    const int fields_count = STELLA_OBJECT_HEADER_FIELD_COUNT(a->object_header);
+    return memcmp(a->object_fields, b->object_fields, fields_count * sizeof(void *)) == 0;
+}
+
+static void table_insert(stella_object **entries, size_t capacity, stella_object *object) {
+    size_t i = hash_object(object, capacity);
+    while (entries[i] != NULL) {
+        i = (i + 1) & (capacity - 1);
+    }
+    entries[i] = object;
+}
+
+static stella_object **alloc_entries(size_t capacity) {
+    stella_object **entries = calloc(capacity, sizeof(stella_object *));
+    if (entries == NULL) {
+        printf("Memory allocation for intern table failed!\n");
+        exit(1);
+    }
+    return entries;
+}
+
+static void table_resize(gc_intern_table_t *table, size_t capacity) {
+    stella_object **entries = alloc_entries(capacity);
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->entries[i] != NULL) {
+            table_insert(entries, capacity, table->entries[i]);
+        }
+    }
+    free(table->entries);
+    table->entries = entries;
+    table->capacity = capacity;
+}
+
+// while copying, a from-space object which was not marked is garbage and must not be handed out again
+static bool is_dead(stella_object *object) {
+    return gc->phase == SWEEP && is_in_current_heap(object)
+           && stella_object_to_gc_object(object)->color != BLACK;
+}
+
+static stella_object *intern(gc_intern_table_t *table, stella_object *object) {
+    if (table->capacity == 0 || (table->count + 1) * 2 > table->capacity) {
+        table_resize(table, table->capacity == 0 ? INTERN_TABLE_MIN_CAPACITY : table->capacity * 2);
+    }
+    size_t i = hash_object(object, table->capacity);
+    while (table->entries[i] != NULL) {
+        stella_object *candidate = table->entries[i];
+        if (objects_equal(candidate, object)) {
+            if (is_dead(candidate)) {
+                // same contents, the new object takes its slot
+                table->entries[i] = object;
+                table->misses += 1;
+                return object;
+            }
+            table->hits += 1;
+            return candidate;
+        }
+        i = (i + 1) & (table->capacity - 1);
+    }
+    table->entries[i] = object;
+    table->count += 1;
+    table->misses += 1;
+    return object;
+}
+
+void gc_set_hash_consing(bool enabled) {
+    gc_init();
+    gc->intern.enabled = enabled;
+}
+
+void *gc_intern(void *object) {
+    if (gc == NULL || !gc->intern.enabled || !is_internable(object)) {
+        return object;
+    }
+    // static and image objects are shared already
+    if (!is_in_current_heap(object) && !(gc->phase == SWEEP && is_in_next_heap(object))) {
+        return object;
+    }
+    if (gc_is_shared()) {
+        pthread_mutex_lock(&gc->lock);
+    }
+    stella_object *result = intern(&gc->intern, object);
+    if (gc_is_shared()) {
+        pthread_mutex_unlock(&gc->lock);
+    }
+    return result;
+}
+
+void sweep_intern_table() {
+    gc_intern_table_t *table = &gc->intern;
+    if (table->count == 0) {
+        return;
+    }
+    // objects allocated while copying are in to-space already, the rest survived if copied
+    size_t survivors = 0;
+    for (size_t i = 0; i < table->capacity; i++) {
+        stella_object *object = table->entries[i];
+        if (object != NULL && is_in_current_heap(object)) {
+            gc_object_t *copy = gc_forwarded(stella_object_to_gc_object(object));
+            table->entries[i] = copy != NULL ? &copy->obj : NULL;
+        }
+        survivors += table->entries[i] != NULL;
+    }
+    size_t capacity = INTERN_TABLE_MIN_CAPACITY;
+    while (capacity < survivors * 4) {
+        capacity *= 2;
+    }
+    // fields have been forwarded, every survivor hashes differently now
+    stella_object **entries = alloc_entries(capacity);
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->entries[i] != NULL) {
+            table_insert(entries, capacity, table->entries[i]);
+        }
+    }
+    free(table->entries);
+    table->entries = entries;
+    table->capacity = capacity;
+    table->count = survivors;
+}
+
+void gc_intern_configure_from_env() {
+    const char *value = getenv("STELLA_GC_HASH_CONS");
+    if (value != NULL && strcmp(value, "1") == 0) {
+        gc->intern.enabled = true;
+    }
+}
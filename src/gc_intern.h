@@ -0,0 +1,29 @@
+#ifndef STELLA_GC_INTERN_H
+#define STELLA_GC_INTERN_H
+
+#include <stdbool.h>
+
+/** Hash-consing of immutable Stella objects.
+ *
+ * While hash-consing is enabled, gc_intern looks a freshly initialised object up in a weak
+ * intern table and returns an existing object with the same header and the same fields
+ * (compared by address) instead, so equal values built bottom-up share one heap object.
+ * Only immutable tags are interned: succ, inl, inr, cons and tuples.
+ *
+ * The table does not keep objects alive: at every flip entries of objects which were not
+ * copied are dropped and the surviving ones are rehashed at their new addresses.
+ */
+
+/** Turn hash-consing on or off for the calling thread's context (off by default). */
+void gc_set_hash_consing(bool enabled);
+
+/** Return an object equal to object if one is interned, otherwise intern object and return it.
+ * object must be fully initialised and must not be written afterwards. Does not allocate,
+ * so it is not a safepoint. Returns object unchanged while hash-consing is off.
+ */
+void *gc_intern(void *object);
+
+/** Enable hash-consing if STELLA_GC_HASH_CONS=1 is set. */
+void gc_intern_configure_from_env();
+
+#endif
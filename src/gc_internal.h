@@ -0,0 +1,515 @@
+#ifndef STELLA_GC_INTERNAL_H
+#define STELLA_GC_INTERNAL_H
+
+// Collector state shared between the GC translation units. Not part of the runtime interface.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "runtime.h"
+#include "queue.h"
+#include "gc_pause.h"
+#include "gc_shm.h"
+#include "gc_profile.h"
+#include "gc_weak.h"
+#include "gc_sample.h"
+#include "gc_context.h"
+#include "gc_roots.h"
+#include "gc_pretenure.h"
+#include "gc_simd.h"
+
+// root stacks start this big and double when full
+#define GC_ROOT_STACK_INITIAL_CAPACITY 64
+#define START_HEAP_SIZE 1024
+// thread-local allocation buffer size when several mutators share a heap
+#define GC_TLAB_SIZE (32 * 1024)
+// depth-first copying stops after this many bytes, the rest is copied when reached again
+#define GC_COPY_GROUP_BYTES 4096
+// fields are prefetched this many fields before the marker or the copier looks at them
+#define GC_PREFETCH_DISTANCE 8
+// objects are word aligned, so a 32-bit forwarding reference covers 32 GB of to-space
+#define GC_FORWARD_ALIGNMENT sizeof(void *)
+#define GC_MAX_HEAP_SIZE ((size_t) UINT32_MAX * GC_FORWARD_ALIGNMENT)
+// enables a lot of debug output during gc work
+// #define STELLA_DEBUG
+
+typedef enum COLOR {
+    WHITE,
+    GREY,
+    BLACK,
+} COLOR;
+
+typedef enum GC_PHASE {
+    MARK,
+    SWEEP,
+} GC_PHASE;
+
+// gc_object_t flags
+// object is a key of some weak map
+#define GC_OBJECT_WEAK_KEY 1
+// unused tail of a thread-local allocation buffer, keeps the heap walkable
+#define GC_OBJECT_FILLER 2
+// object of a heap image, never moves
+#define GC_OBJECT_IMMORTAL 4
+// immortal object in the remembered set
+#define GC_OBJECT_REMEMBERED 8
+
+// maximum number of heap images loaded into one GC
+#define GC_MAX_IMAGES 8
+
+// address space reserved for the mature (non-moving) space
+#define GC_MATURE_SPACE_RESERVE ((size_t) 256 << 20)
+// freed mature blocks smaller than this many words are reused through exact size free lists
+#define GC_MATURE_SIZE_CLASSES 32
+
+// the whole GC header is one word: the forwarding reference is a compressed to-space offset
+typedef struct gc_object_t {
+    // COLOR
+    unsigned char color : 2;
+    unsigned char flags : 6;
+    // number of collections survived (saturates at 255)
+    unsigned char age;
+    // allocation site
+    unsigned short site;
+    // where the object has been copied: offset in to-space in words plus one, 0 if not copied;
+    // free blocks of the mature space are linked the same way (see gc_pretenure.c)
+    uint32_t forward;
+    stella_object obj;
+} gc_object_t;
+
+_Static_assert(sizeof(gc_object_t) == sizeof(void *) + sizeof(stella_object), "GC header is one word");
+
+typedef struct gc_stats_t {
+    unsigned long total_allocated_bytes;
+    unsigned long total_allocated_objects;
+
+    unsigned long max_residency_bytes;
+    unsigned long max_residency_objects;
+
+    unsigned long last_residency_bytes;
+    unsigned long last_residency_objects;
+
+    unsigned long current_allocated_bytes;
+    unsigned long current_allocated_objects;
+
+    unsigned long total_reads;
+    unsigned long total_writes;
+
+    unsigned long gc_roots_max_size;
+
+    unsigned long mark_steps;
+    unsigned long sweep_steps;
+    unsigned long sweep_phase_count;
+    unsigned long mark_phase_count;
+    unsigned long marked_objects;
+} gc_stats_t;
+
+// counters updated by a mutator thread, summed up by gc_aggregate_stats
+typedef struct gc_mutator_stats_t {
+    unsigned long allocated_bytes;
+    unsigned long allocated_objects;
+    unsigned long current_allocated_bytes;
+    unsigned long current_allocated_objects;
+    unsigned long reads;
+    unsigned long writes;
+    unsigned long roots_max_size;
+} gc_mutator_stats_t;
+
+// a stack of root addresses, one per evaluation (thread or coroutine)
+struct gc_root_stack_t {
+    struct gc_t *context;
+    stella_object ***roots;
+    int roots_cont;
+    int capacity;
+
+    // while suspended, the stack is in the pending (not scanned in this mark cycle) or scanned list
+    bool suspended;
+    bool scanned;
+    struct gc_root_stack_t *prev;
+    struct gc_root_stack_t *next;
+};
+
+// a thread running Stella code on a context
+typedef struct gc_mutator_t {
+    struct gc_t *context;
+
+    // roots info: the active root stack, the thread's own one unless switched
+    gc_root_stack_t *stack;
+    gc_root_stack_t default_stack;
+
+    // thread-local allocation buffer (only while several mutators share the heap),
+    // objects in [tlab_start, tlab_scanned) have been handed to the collector
+    void *tlab_start;
+    void *tlab_scanned;
+    void *tlab_top;
+    void *tlab_end;
+
+    // write barrier records kept until the next safepoint (contents to grey, or copies to fix)
+    void **barrier_buffer;
+    size_t barrier_buffer_count;
+    size_t barrier_buffer_capacity;
+
+    // objects allocated since the mutator last ran collector steps
+    unsigned long steps_owed;
+
+    gc_mutator_stats_t stats;
+
+    // stopped at a safepoint, blocked, or not bound to any thread
+    bool parked;
+    struct gc_mutator_t *next;
+} gc_mutator_t;
+
+// a mapped heap image (gc_image.c)
+typedef struct gc_image_region_t {
+    void *mapping;
+    size_t mapping_size;
+    void *objects;
+    size_t objects_size;
+} gc_image_region_t;
+
+// weak hash-consing table (gc_intern.c), open addressing over interned objects
+typedef struct gc_intern_table_t {
+    stella_object **entries;
+    size_t capacity;
+    size_t count;
+    bool enabled;
+    unsigned long hits;
+    unsigned long misses;
+} gc_intern_table_t;
+
+// allocation and survival counters of a site (gc_pretenure.c)
+typedef struct gc_site_t {
+    gc_site_stats_t stats;
+    // objects of the current from-space which survived one collection, judged at the next flip
+    uint64_t cycle_objects;
+    // objects copied for the first time in this cycle, judged one flip later
+    uint64_t next_objects;
+} gc_site_t;
+
+// objects of pretenured sites: marked like heap objects, never copied, freed at flip
+typedef struct gc_mature_space_t {
+    void *start;
+    void *top;
+    void *end;
+    // freed blocks by size in words, linked through forward
+    gc_object_t *free_lists[GC_MATURE_SIZE_CLASSES];
+    // freed blocks of GC_MATURE_SIZE_CLASSES words or more, reused first fit
+    gc_object_t *large_free;
+    size_t used_bytes;
+} gc_mature_space_t;
+
+// fields waiting for their headers to arrive in cache, oldest first
+typedef struct gc_prefetch_ring_t {
+    void *entries[GC_PREFETCH_DISTANCE];
+    unsigned head;
+    unsigned count;
+} gc_prefetch_ring_t;
+
+typedef struct gc_sweep_helper_t {
+    void *next_heap;
+    size_t next_heap_size;
+    unsigned long sweep_allocated_bytes;
+    unsigned long sweep_allocated_objects;
+    void *next;
+    // objects allocated in to-space while copying, their fields are forwarded at flip
+    queue_t *allocated;
+} gc_sweep_helper_t;
+
+
+typedef struct gc_t {
+    // mutator of the thread the context is bound to, followed by attached ones
+    gc_mutator_t primary;
+    gc_mutator_t *mutators;
+    int mutators_count;
+    int mutators_parked;
+    // more than one mutator, allocation goes through TLABs (changed inside a safepoint only)
+    bool shared;
+
+    // safepoint handshake, the lock also protects collector state while several mutators run
+    pthread_mutex_t lock;
+    pthread_cond_t parked_cond;
+    pthread_cond_t resume_cond;
+    _Atomic bool safepoint_requested;
+
+    // suspended root stacks, they cannot change until switched to, so each is scanned once per mark cycle
+    gc_root_stack_t *pending_root_stacks;
+    gc_root_stack_t *scanned_root_stacks;
+
+    // in what phase GC now
+    GC_PHASE phase;
+
+    // queue for mark phase
+    queue_t *grey_queue;
+
+    // queue for sweep phase
+    queue_t *black_queue;
+
+    // evacuation order, and the stack of objects still to copy in depth-first order
+    GC_COPY_ORDER copy_order;
+    gc_object_t **copy_stack;
+    size_t copy_stack_count;
+    size_t copy_stack_capacity;
+
+    // objects to grey while marking, field slots to forward while copying
+    gc_prefetch_ring_t mark_prefetch;
+    gc_prefetch_ring_t copy_prefetch;
+
+    // garbage collector statistic
+    gc_stats_t stats;
+
+    // where to store current objects and where to move them in sweep phase
+    void *current_heap;
+    void *next_place_in_heap;
+    size_t current_heap_size;
+    // the heap never shrinks below its initial size (STELLA_GC_HEAP_SIZE)
+    size_t min_heap_size;
+    // heap limits, 0 is none (gc_set_heap_limits), and what to do when the hard one is hit
+    size_t soft_heap_limit;
+    size_t hard_heap_limit;
+    gc_oom_handler_t oom_handler;
+    void *oom_data;
+
+    // bytes blackened in the current cycle, estimate of live data for sizing to-space
+    size_t marked_bytes;
+
+    gc_sweep_helper_t sweep_helper;
+
+    // pause times and mutator utilisation
+    gc_pause_tracker_t pauses;
+
+    // live stats page for external monitoring, NULL if not published
+    gc_shm_page_t *shm;
+
+    // per-tag allocation and survival
+    gc_tag_profile_t tags;
+
+    // maps which must be re-keyed when their keys move
+    gc_weak_map_t *weak_maps[GC_MAX_WEAK_MAPS];
+    int weak_maps_count;
+
+    // sampling allocation profiler
+    gc_alloc_sampler_t sampler;
+
+    // immortal objects loaded from heap images
+    gc_image_region_t images[GC_MAX_IMAGES];
+    int images_count;
+
+    // immortal objects which were written a heap pointer, scanned like roots
+    gc_object_t **remembered;
+    size_t remembered_count;
+    size_t remembered_capacity;
+
+    // hash-consed immutable objects, does not keep them alive
+    gc_intern_table_t intern;
+
+    // per-site survival, allocated on first use; sites reaching the threshold (0 is off) are pretenured
+    gc_site_t *sites;
+    double pretenure_threshold;
+    gc_mature_space_t mature;
+} gc_t;
+
+// NULL if there is no memory for it
+void *alloc_heap(size_t size);
+
+bool is_enough_place_in_current_heap(size_t size_in_bytes);
+
+void *try_alloc(size_t size_in_bytes);
+
+void *try_alloc_object(size_t size_in_bytes);
+
+// live bytes of from-space not copied yet, to-space keeps room for them
+size_t gc_bytes_to_copy();
+
+// make room for an allocation which failed attempt times already: a full collection growing the
+// heap within the soft limit first, then past it up to the hard one; false if this attempt could
+// not grow the heap, so that retrying is pointless (see gc_out_of_memory)
+bool gc_collect_for(int attempt);
+
+// hand an allocation which cannot be satisfied to the out-of-memory handler, does not return
+void gc_out_of_memory(size_t size_in_bytes);
+
+bool mark_step();
+
+void gc_step();
+
+void gc_full();
+
+void mark_roots();
+
+// root stacks (gc_roots.c)
+
+void gc_root_stack_init(gc_root_stack_t *stack, gc_t *context);
+
+void gc_root_stack_free(gc_root_stack_t *stack);
+
+void gc_root_stack_grow(gc_root_stack_t *stack);
+
+// every root stack of gc, active and suspended
+void gc_visit_root_stacks(void (*visit)(gc_root_stack_t *stack, void *data), void *data);
+
+// scan one suspended stack not scanned in this cycle yet, false if there are none
+bool mark_next_suspended_root_stack();
+
+// a new mark cycle starts, suspended stacks have to be scanned again
+void gc_root_stacks_flip();
+
+void make_stella_object_grey_if_needed(stella_object *stella_obj);
+
+void sweep_cleanup();
+
+bool sweep_step();
+
+void sweep_finish();
+
+void sweep_chase(gc_object_t *old_gc_obj);
+
+void sweep_copy_group(gc_object_t *old_gc_obj);
+
+void *sweep_forward(stella_object *stella_obj);
+
+// forward every field of a to-space or mature object which still points into from-space
+void sweep_forward_fields(gc_object_t *obj);
+
+void gc_update_stats_after_object_alloc(size_t size_in_bytes);
+
+gc_stats_t gc_aggregate_stats();
+
+void gc_update_stats_after_flip();
+
+void gc_publish_shm_stats();
+
+bool is_enough_place_in_next_heap(size_t size_in_bytes);
+
+void *try_alloc_in_next(size_t size_in_bytes);
+
+void has_ill_fields_rec(gc_object_t *object);
+
+// false if there is no memory for a to-space of that size
+bool gc_init_sweep_helper(size_t size_in_bytes);
+
+gc_object_t *stella_object_to_gc_object(void *ptr);
+
+size_t get_gc_object_size(gc_object_t *obj);
+
+extern _Thread_local gc_t *gc; // Garbage collector instance bound to this thread
+extern _Thread_local gc_mutator_t *gc_mutator; // this thread's mutator of gc
+
+// multi-mutator support (gc_mutator.c)
+
+void gc_mutator_init(gc_mutator_t *mutator, gc_t *context);
+
+void gc_mutator_free(gc_mutator_t *mutator);
+
+static inline bool gc_is_shared() {
+    return gc->shared;
+}
+
+// park at a safepoint if the collector asked for one
+void gc_safepoint_park();
+
+static inline void gc_safepoint_poll() {
+    if (atomic_load_explicit(&gc->safepoint_requested, memory_order_relaxed)) {
+        gc_safepoint_park();
+    }
+}
+
+// stop all other mutators of gc, returns with gc->lock held
+void gc_safepoint_begin();
+
+void gc_safepoint_end();
+
+// hand objects allocated and written since the last safepoint to the collector
+void gc_mutators_flush();
+
+// give up all TLABs, the next allocation of every mutator starts a fresh one
+void gc_mutators_retire_tlabs();
+
+// fill [start, end) with unreachable filler objects so that the space stays walkable
+void gc_fill_gap(void *start, void *end);
+
+void *gc_tlab_alloc(size_t size_in_bytes);
+
+void gc_barrier_buffer_push(void *object);
+
+// heap images (gc_image.c)
+
+bool gc_is_in_image(void *ptr);
+
+// register mapped immortal objects (images, loaded input), false if there are too many regions
+bool gc_add_image_region(const gc_image_region_t *region);
+
+// object is immortal, contents is about to be stored into it
+void gc_remember_image_write(void *object, void *contents);
+
+void mark_remembered_set();
+
+// forward fields of remembered objects, dropping those which no longer refer to the heap
+void sweep_remembered_set();
+
+void gc_images_free();
+
+// hash-consing (gc_intern.c)
+
+void gc_intern_table_init(gc_intern_table_t *table);
+
+void gc_intern_table_free(gc_intern_table_t *table);
+
+// drop entries which were not copied and rehash the rest at their new addresses
+void sweep_intern_table();
+
+// allocation sites and the mature space (gc_pretenure.c)
+
+void gc_site_alloc(int site, size_t size_in_bytes, bool mature);
+
+// an object of the site of the given age (before the copy) is copied
+void gc_site_survive(int site, unsigned char age);
+
+// settle survival of the cycle that has just finished and pretenure sites
+void gc_pretenure_flip();
+
+// NULL if the mature space is full; outside shared mode the caller runs the collector step first
+gc_object_t *gc_alloc_mature(size_t size_in_bytes, int site);
+
+// forward fields of live mature objects, their referents are copied
+void sweep_mature_space();
+
+// not copied, or an unmarked mature object
+bool is_dead_at_flip(void *object);
+
+// free unmarked mature objects and whiten the rest for the next cycle
+void gc_mature_space_flip();
+
+void gc_pretenure_free();
+
+static inline bool gc_is_in_mature(void *ptr) {
+    return ptr >= gc->mature.start && ptr < gc->mature.top;
+}
+
+static inline bool is_in_current_heap(void *ptr) {
+    return ptr >= gc->current_heap && ptr < gc->current_heap + gc->current_heap_size;
+}
+
+static inline bool is_in_next_heap(void *ptr) {
+    return ptr >= gc->sweep_helper.next_heap && ptr < gc->sweep_helper.next_heap + gc->sweep_helper.next_heap_size;
+}
+
+// copy of a from-space object while copying, NULL if it has not been copied
+static inline gc_object_t *gc_forwarded(gc_object_t *obj) {
+    if (obj->forward == 0) {
+        return NULL;
+    }
+    return gc->sweep_helper.next_heap + (size_t) (obj->forward - 1) * GC_FORWARD_ALIGNMENT;
+}
+
+static inline void gc_set_forwarded(gc_object_t *obj, gc_object_t *copy) {
+    obj->forward = (uint32_t) (((void *) copy - gc->sweep_helper.next_heap) / GC_FORWARD_ALIGNMENT) + 1;
+}
+
+// bit i is set if fields[i] points into from-space (objects have at most 15 fields)
+static inline uint64_t heap_fields_mask(void **fields, int count) {
+    return gc_fields_in_range(fields, count, gc->current_heap, gc->current_heap + gc->current_heap_size);
+}
+
+#endif
@@ -0,0 +1,354 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gc.h"
+#include "gc_internal.h"
+#include "gc_trace.h"
+
+// Several threads (mutators) running Stella code on one context.
+//
+// While a single mutator uses the context (direct mode) it allocates and runs collector
+// steps itself, exactly as before. Once a second one attaches, the heap is shared:
+// allocation bumps a thread-local allocation buffer (TLAB) carved out of the heap, and
+// barriers only record what the collector has to know. The collector runs when a TLAB
+// is exhausted, with every other mutator stopped at a safepoint, so collector state is
+// never touched concurrently.
+
+_Thread_local gc_mutator_t *gc_mutator = NULL;
+
+// filler objects cover at most 15 fields
+#define FILLER_MAX_SIZE (sizeof(gc_object_t) + 15 * sizeof(void *))
+
+void gc_mutator_init(gc_mutator_t *mutator, gc_t *context) {
+    memset(mutator, 0, sizeof(gc_mutator_t));
+    mutator->context = context;
+    gc_root_stack_init(&mutator->default_stack, context);
+    mutator->stack = &mutator->default_stack;
+    mutator->parked = true;
+}
+
+void gc_mutator_free(gc_mutator_t *mutator) {
+    gc_root_stack_free(&mutator->default_stack);
+    free(mutator->barrier_buffer);
+    mutator->barrier_buffer = NULL;
+    mutator->barrier_buffer_count = 0;
+    mutator->barrier_buffer_capacity = 0;
+}
+
+// the calling thread runs a mutator of gc which is not parked
+static bool is_running_member() {
+    return gc_mutator != NULL && gc_mutator->context == gc && !gc_mutator->parked;
+}
+
+// with gc->lock held
+static void park_locked(gc_mutator_t *mutator) {
+    mutator->parked = true;
+    gc->mutators_parked += 1;
+    pthread_cond_broadcast(&gc->parked_cond);
+}
+
+// with gc->lock held, waits for a running safepoint to end
+static void unpark_locked(gc_mutator_t *mutator) {
+    while (atomic_load(&gc->safepoint_requested)) {
+        pthread_cond_wait(&gc->resume_cond, &gc->lock);
+    }
+    mutator->parked = false;
+    gc->mutators_parked -= 1;
+}
+
+void gc_safepoint_park() {
+    pthread_mutex_lock(&gc->lock);
+    if (atomic_load(&gc->safepoint_requested)) {
+        park_locked(gc_mutator);
+        unpark_locked(gc_mutator);
+    }
+    pthread_mutex_unlock(&gc->lock);
+}
+
+void gc_safepoint_begin() {
+    pthread_mutex_lock(&gc->lock);
+    // somebody else is stopping the world, let them finish first
+    while (atomic_load(&gc->safepoint_requested)) {
+        if (is_running_member()) {
+            park_locked(gc_mutator);
+            unpark_locked(gc_mutator);
+        } else {
+            pthread_cond_wait(&gc->resume_cond, &gc->lock);
+        }
+    }
+    atomic_store(&gc->safepoint_requested, true);
+    const int running = is_running_member() ? 1 : 0;
+    while (gc->mutators_parked < gc->mutators_count - running) {
+        pthread_cond_wait(&gc->parked_cond, &gc->lock);
+    }
+}
+
+void gc_safepoint_end() {
+    atomic_store(&gc->safepoint_requested, false);
+    pthread_cond_broadcast(&gc->resume_cond);
+    pthread_mutex_unlock(&gc->lock);
+}
+
+void gc_safepoint() {
+    if (gc != NULL && gc_mutator != NULL) {
+        gc_safepoint_poll();
+    }
+}
+
+void gc_blocking_begin() {
+    if (gc == NULL || gc_mutator == NULL || gc_mutator->parked) {
+        return;
+    }
+    pthread_mutex_lock(&gc->lock);
+    park_locked(gc_mutator);
+    pthread_mutex_unlock(&gc->lock);
+}
+
+void gc_blocking_end() {
+    if (gc == NULL || gc_mutator == NULL || !gc_mutator->parked) {
+        return;
+    }
+    pthread_mutex_lock(&gc->lock);
+    unpark_locked(gc_mutator);
+    pthread_mutex_unlock(&gc->lock);
+}
+
+void gc_barrier_buffer_push(void *object) {
+    gc_mutator_t *mutator = gc_mutator;
+    if (mutator->barrier_buffer_count == mutator->barrier_buffer_capacity) {
+        size_t capacity = mutator->barrier_buffer_capacity == 0 ? 256 : mutator->barrier_buffer_capacity * 2;
+        void **buffer = realloc(mutator->barrier_buffer, capacity * sizeof(void *));
+        if (buffer == NULL) {
+            printf("Memory allocation for write barrier buffer failed!\n");
+            exit(1);
+        }
+        mutator->barrier_buffer = buffer;
+        mutator->barrier_buffer_capacity = capacity;
+    }
+    mutator->barrier_buffer[mutator->barrier_buffer_count++] = object;
+}
+
+static void flush_mutator(gc_mutator_t *mutator) {
+    // objects allocated since the last safepoint, in the phase they were allocated in
+    for (void *p = mutator->tlab_scanned; p < mutator->tlab_top; p += get_gc_object_size(p)) {
+        gc_object_t *gc_obj = p;
+        const int tag = STELLA_OBJECT_HEADER_TAG(gc_obj->obj.object_header);
+        if (gc->phase == MARK) {
+            gc_tag_profile_alloc(&gc->tags, tag, get_gc_object_size(gc_obj));
+            gc_site_alloc(gc_obj->site, get_gc_object_size(gc_obj), false);
+            make_stella_object_grey_if_needed(&gc_obj->obj);
+        } else {
+            gc_tag_profile_alloc_next(&gc->tags, tag, get_gc_object_size(gc_obj));
+            gc_site_alloc(gc_obj->site, get_gc_object_size(gc_obj), false);
+            push(gc->sweep_helper.allocated, gc_obj);
+        }
+        mutator->steps_owed += 1;
+    }
+    mutator->tlab_scanned = mutator->tlab_top;
+    // overwritten contents to grey, or copies whose fields must be forwarded again
+    for (size_t i = 0; i < mutator->barrier_buffer_count; i++) {
+        if (gc->phase == MARK) {
+            make_stella_object_grey_if_needed(mutator->barrier_buffer[i]);
+        } else {
+            push(gc->black_queue, mutator->barrier_buffer[i]);
+        }
+    }
+    mutator->barrier_buffer_count = 0;
+}
+
+void gc_mutators_flush() {
+    for (gc_mutator_t *mutator = gc->mutators; mutator != NULL; mutator = mutator->next) {
+        flush_mutator(mutator);
+    }
+}
+
+void gc_fill_gap(void *start, void *end) {
+    size_t rest = end - start;
+    while (rest > 0) {
+        size_t size = rest < FILLER_MAX_SIZE ? rest : FILLER_MAX_SIZE;
+        // never leave a gap smaller than an object header
+        if (rest - size != 0 && rest - size < sizeof(gc_object_t)) {
+            size = rest - sizeof(gc_object_t);
+        }
+        gc_object_t *filler = start;
+        const int fields_count = (size - sizeof(gc_object_t)) / sizeof(void *);
+        filler->color = WHITE;
+        filler->age = 0;
+        filler->flags = GC_OBJECT_FILLER;
+        filler->site = 0;
+        filler->forward = 0;
+        filler->obj.object_header = TAG_MASK | fields_count << 4;
+        memset(filler->obj.object_fields, 0, fields_count * sizeof(void *));
+        start += size;
+        rest -= size;
+    }
+}
+
+static void retire_tlab(gc_mutator_t *mutator) {
+    if (mutator->tlab_top != NULL) {
+        gc_fill_gap(mutator->tlab_top, mutator->tlab_end);
+    }
+    mutator->tlab_start = NULL;
+    mutator->tlab_scanned = NULL;
+    mutator->tlab_top = NULL;
+    mutator->tlab_end = NULL;
+}
+
+void gc_mutators_retire_tlabs() {
+    for (gc_mutator_t *mutator = gc->mutators; mutator != NULL; mutator = mutator->next) {
+        retire_tlab(mutator);
+    }
+}
+
+// a new buffer for at least size_in_bytes from the space objects go to in the current phase,
+// NULL if the heap is too full
+static void *carve_tlab(size_t size_in_bytes, size_t *tlab_size) {
+    size_t available;
+    if (gc->phase == SWEEP) {
+        available = gc->sweep_helper.next_heap + gc->sweep_helper.next_heap_size - gc->sweep_helper.next;
+        // leave room for copying the rest of the live data
+        const size_t to_copy = gc_bytes_to_copy();
+        available = available > to_copy ? available - to_copy : 0;
+    } else {
+        available = gc->current_heap + gc->current_heap_size - gc->next_place_in_heap;
+    }
+    // a share of the free space, so that one thread does not take all of it
+    size_t size = available / (4 * gc->mutators_count) / sizeof(void *) * sizeof(void *);
+    size = size > GC_TLAB_SIZE ? GC_TLAB_SIZE : size;
+    if (size < size_in_bytes || size - size_in_bytes < sizeof(gc_object_t)) {
+        size = size_in_bytes;
+    }
+    if (size >= available) {
+        return NULL;
+    }
+    *tlab_size = size;
+    return try_alloc_object(size);
+}
+
+static void *tlab_refill(size_t size_in_bytes) {
+    gc_mutator_t *mutator = gc_mutator;
+    gc_safepoint_begin();
+    gc_mutators_flush();
+    retire_tlab(mutator);
+    // one collector step per object allocated, as in direct mode; steps are repeated
+    // for nothing once marking is done, the world is stopped and nothing can change
+    unsigned long steps = mutator->steps_owed;
+    mutator->steps_owed = 0;
+    for (unsigned long i = 0; i < steps; i++) {
+        gc_step();
+        if (gc->phase == MARK && is_empty(gc->grey_queue) && gc->mark_prefetch.count == 0) {
+            break;
+        }
+    }
+    size_t tlab_size;
+    void *tlab = carve_tlab(size_in_bytes, &tlab_size);
+    for (int attempt = 0; tlab == NULL; attempt++) {
+        const bool can_retry = gc_collect_for(attempt);
+        tlab = carve_tlab(size_in_bytes, &tlab_size);
+        if (tlab == NULL && !can_retry) {
+            // the handler may not come back, other mutators must not stay stopped
+            gc_safepoint_end();
+            gc_out_of_memory(size_in_bytes);
+        }
+    }
+    mutator->tlab_start = tlab;
+    mutator->tlab_scanned = tlab;
+    mutator->tlab_top = tlab + size_in_bytes;
+    mutator->tlab_end = tlab + tlab_size;
+    gc_safepoint_end();
+    return tlab;
+}
+
+void *gc_tlab_alloc(size_t size_in_bytes) {
+    gc_mutator_t *mutator = gc_mutator;
+    void *top = mutator->tlab_top;
+    if (top != NULL && size_in_bytes <= (size_t) (mutator->tlab_end - top)) {
+        size_t rest = mutator->tlab_end - top - size_in_bytes;
+        // the rest must fit a filler object when the buffer is retired
+        if (rest == 0 || rest >= sizeof(gc_object_t)) {
+            mutator->tlab_top = top + size_in_bytes;
+            return top;
+        }
+    }
+    return tlab_refill(size_in_bytes);
+}
+
+
+void gc_context_attach(gc_context_t *context) {
+    gc_context_bind(NULL);
+    gc_mutator_t *mutator = malloc(sizeof(gc_mutator_t));
+    if (mutator == NULL) {
+        printf("Memory allocation for GC mutator failed!\n");
+        exit(1);
+    }
+    gc_mutator_init(mutator, context);
+    mutator->parked = false;
+    gc = context;
+    gc_safepoint_begin();
+    gc_mutator_t *last = gc->mutators;
+    while (last->next != NULL) {
+        last = last->next;
+    }
+    last->next = mutator;
+    gc->mutators_count += 1;
+    // a direct mode mutator has no TLAB, it starts using one from its next allocation
+    gc->shared = true;
+    gc_safepoint_end();
+    gc_mutator = mutator;
+}
+
+void gc_context_detach() {
+    if (gc == NULL) {
+        return;
+    }
+    gc_mutator_t *mutator = gc_mutator;
+    if (mutator == &gc->primary) {
+        gc_context_bind(NULL);
+        return;
+    }
+    gc_blocking_end();
+    // a stack the thread switched to stays with the context, its own one goes away
+    gc_root_stack_switch(&mutator->default_stack);
+    gc_safepoint_begin();
+    // counters of the thread stay with the context
+    gc->stats.total_allocated_bytes += mutator->stats.allocated_bytes;
+    gc->stats.total_allocated_objects += mutator->stats.allocated_objects;
+    gc->stats.current_allocated_bytes += mutator->stats.current_allocated_bytes;
+    gc->stats.current_allocated_objects += mutator->stats.current_allocated_objects;
+    gc->stats.total_reads += mutator->stats.reads;
+    gc->stats.total_writes += mutator->stats.writes;
+    if (gc->stats.gc_roots_max_size < mutator->stats.roots_max_size) {
+        gc->stats.gc_roots_max_size = mutator->stats.roots_max_size;
+    }
+    gc_mutators_flush();
+    gc_mutators_retire_tlabs();
+    gc_mutator_t **link = &gc->mutators;
+    while (*link != mutator) {
+        link = &(*link)->next;
+    }
+    *link = mutator->next;
+    gc->mutators_count -= 1;
+    gc->shared = gc->mutators_count > 1;
+    gc_safepoint_end();
+    gc_mutator_free(mutator);
+    free(mutator);
+    gc = NULL;
+    gc_mutator = NULL;
+}
+
+gc_stats_t gc_aggregate_stats() {
+    gc_stats_t stats = gc->stats;
+    for (gc_mutator_t *mutator = gc->mutators; mutator != NULL; mutator = mutator->next) {
+        stats.total_allocated_bytes += mutator->stats.allocated_bytes;
+        stats.total_allocated_objects += mutator->stats.allocated_objects;
+        stats.current_allocated_bytes += mutator->stats.current_allocated_bytes;
+        stats.current_allocated_objects += mutator->stats.current_allocated_objects;
+        stats.total_reads += mutator->stats.reads;
+        stats.total_writes += mutator->stats.writes;
+        if (stats.gc_roots_max_size < mutator->stats.roots_max_size) {
+            stats.gc_roots_max_size = mutator->stats.roots_max_size;
+        }
+    }
+    return stats;
+}
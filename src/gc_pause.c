@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "gc_pause.h"
+
+static const uint64_t default_mmu_windows_ns[] = {1000000, 10000000, 100000000};
+
+uint64_t gc_clock_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static int histogram_bucket(uint64_t value) {
+    if (value < GC_HISTOGRAM_SUB_BUCKETS) {
+        return (int) value;
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    int sub_bucket = (int) (value >> (exponent - 4)) & (GC_HISTOGRAM_SUB_BUCKETS - 1);
+    return (exponent - 3) * GC_HISTOGRAM_SUB_BUCKETS + sub_bucket;
+}
+
+// highest value which falls into the bucket
+static uint64_t histogram_bucket_limit(int bucket) {
+    if (bucket < GC_HISTOGRAM_SUB_BUCKETS) {
+        return bucket;
+    }
+    int exponent = bucket / GC_HISTOGRAM_SUB_BUCKETS + 3;
+    uint64_t sub_bucket = bucket % GC_HISTOGRAM_SUB_BUCKETS;
+    return ((GC_HISTOGRAM_SUB_BUCKETS + sub_bucket + 1) << (exponent - 4)) - 1;
+}
+
+static void histogram_record(gc_histogram_t *histogram, uint64_t value) {
+    histogram->counts[histogram_bucket(value)] += 1;
+    histogram->count += 1;
+    histogram->total_ns += value;
+    if (value > histogram->max_ns) {
+        histogram->max_ns = value;
+    }
+}
+
+static uint64_t histogram_percentile(const gc_histogram_t *histogram, double percentile) {
+    if (histogram->count == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t) (percentile / 100.0 * histogram->count);
+    if (rank >= histogram->count) {
+        rank = histogram->count - 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < GC_HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen > rank) {
+            uint64_t limit = histogram_bucket_limit(i);
+            return limit < histogram->max_ns ? limit : histogram->max_ns;
+        }
+    }
+    return histogram->max_ns;
+}
+
+void gc_pause_tracker_init(gc_pause_tracker_t *tracker) {
+    memset(tracker, 0, sizeof(gc_pause_tracker_t));
+    tracker->start_ns = gc_clock_ns();
+    gc_pause_tracker_set_mmu_windows(tracker, default_mmu_windows_ns,
+                                     sizeof(default_mmu_windows_ns) / sizeof(default_mmu_windows_ns[0]));
+}
+
+void gc_pause_tracker_free(gc_pause_tracker_t *tracker) {
+    free(tracker->log);
+    tracker->log = NULL;
+}
+
+uint64_t gc_pause_begin(gc_pause_tracker_t *tracker) {
+    tracker->depth += 1;
+    return gc_clock_ns();
+}
+
+void gc_pause_end(gc_pause_tracker_t *tracker, GC_PAUSE_KIND kind, uint64_t start_ns) {
+    uint64_t end_ns = gc_clock_ns();
+    histogram_record(&tracker->histograms[kind], end_ns - start_ns);
+    tracker->depth -= 1;
+    if (tracker->depth > 0) {
+        return;
+    }
+    tracker->total_gc_ns += end_ns - start_ns;
+    if (tracker->log == NULL) {
+        tracker->log = malloc(GC_PAUSE_LOG_SIZE * sizeof(gc_pause_record_t));
+        if (tracker->log == NULL) {
+            return;
+        }
+    }
+    gc_pause_record_t *record = &tracker->log[tracker->log_head % GC_PAUSE_LOG_SIZE];
+    record->start_ns = start_ns;
+    record->end_ns = end_ns;
+    tracker->log_head += 1;
+}
+
+void gc_pause_tracker_set_mmu_windows(gc_pause_tracker_t *tracker, const uint64_t *windows_ns, int count) {
+    if (count > GC_MMU_MAX_WINDOWS) {
+        count = GC_MMU_MAX_WINDOWS;
+    }
+    tracker->mmu_windows_count = count;
+    for (int i = 0; i < count; i++) {
+        tracker->mmu_windows_ns[i] = windows_ns[i];
+    }
+}
+
+// GC time inside [from, to], pauses are sorted and prefix[i] is the total length of first i pauses
+static uint64_t gc_time_in_window(const gc_pause_record_t *pauses, const uint64_t *prefix, size_t count,
+                                  uint64_t from, uint64_t to) {
+    // first pause ending after from
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (pauses[mid].end_ns <= from) { lo = mid + 1; } else { hi = mid; }
+    }
+    size_t first = lo;
+    // first pause starting at or after to
+    lo = first;
+    hi = count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (pauses[mid].start_ns < to) { lo = mid + 1; } else { hi = mid; }
+    }
+    size_t last = lo;
+    if (first >= last) {
+        return 0;
+    }
+    uint64_t total = prefix[last] - prefix[first];
+    if (pauses[first].start_ns < from) {
+        total -= from - pauses[first].start_ns;
+    }
+    if (pauses[last - 1].end_ns > to) {
+        total -= pauses[last - 1].end_ns - to;
+    }
+    return total;
+}
+
+// worst window either starts at a pause start or ends at a pause end
+static double minimum_mutator_utilisation(const gc_pause_record_t *pauses, const uint64_t *prefix, size_t count,
+                                          uint64_t begin, uint64_t end, uint64_t window) {
+    if (window == 0 || end - begin < window) {
+        return end > begin ? 1.0 - (double) prefix[count] / (double) (end - begin) : 1.0;
+    }
+    uint64_t worst = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t from = pauses[i].start_ns;
+        if (from + window > end) {
+            from = end - window;
+        }
+        uint64_t gc_time = gc_time_in_window(pauses, prefix, count, from, from + window);
+        if (gc_time > worst) { worst = gc_time; }
+
+        uint64_t to = pauses[i].end_ns;
+        if (to < begin + window) {
+            to = begin + window;
+        }
+        gc_time = gc_time_in_window(pauses, prefix, count, to - window, to);
+        if (gc_time > worst) { worst = gc_time; }
+    }
+    return 1.0 - (double) worst / (double) window;
+}
+
+void gc_pause_tracker_collect(const gc_pause_tracker_t *tracker, gc_pause_stats_t *stats) {
+    uint64_t now = gc_clock_ns();
+    memset(stats, 0, sizeof(gc_pause_stats_t));
+    for (int kind = 0; kind < GC_PAUSE_KINDS_COUNT; kind++) {
+        const gc_histogram_t *histogram = &tracker->histograms[kind];
+        gc_pause_summary_t *summary = &stats->kinds[kind];
+        summary->count = histogram->count;
+        summary->total_ns = histogram->total_ns;
+        summary->p50_ns = histogram_percentile(histogram, 50.0);
+        summary->p90_ns = histogram_percentile(histogram, 90.0);
+        summary->p99_ns = histogram_percentile(histogram, 99.0);
+        summary->p999_ns = histogram_percentile(histogram, 99.9);
+        summary->max_ns = histogram->max_ns;
+    }
+    stats->total_gc_ns = tracker->total_gc_ns;
+    stats->elapsed_ns = now - tracker->start_ns;
+    stats->mmu_windows_count = tracker->mmu_windows_count;
+
+    // unroll the pause ring into time order
+    size_t count = tracker->log_head < GC_PAUSE_LOG_SIZE ? tracker->log_head : GC_PAUSE_LOG_SIZE;
+    gc_pause_record_t *pauses = malloc((count + 1) * sizeof(gc_pause_record_t));
+    uint64_t *prefix = malloc((count + 1) * sizeof(uint64_t));
+    if (pauses == NULL || prefix == NULL) {
+        free(pauses);
+        free(prefix);
+        return;
+    }
+    prefix[0] = 0;
+    for (size_t i = 0; i < count; i++) {
+        pauses[i] = tracker->log[(tracker->log_head - count + i) % GC_PAUSE_LOG_SIZE];
+        prefix[i + 1] = prefix[i] + (pauses[i].end_ns - pauses[i].start_ns);
+    }
+    uint64_t begin = count == tracker->log_head ? tracker->start_ns : pauses[0].start_ns;
+    for (int i = 0; i < tracker->mmu_windows_count; i++) {
+        stats->mmu_windows_ns[i] = tracker->mmu_windows_ns[i];
+        stats->mmu[i] = minimum_mutator_utilisation(pauses, prefix, count, begin, now, tracker->mmu_windows_ns[i]);
+    }
+    free(pauses);
+    free(prefix);
+}
+
+void gc_pause_stats_print(const gc_pause_stats_t *stats) {
+    static const char *const names[GC_PAUSE_KINDS_COUNT] = {
+        [GC_PAUSE_STEP] = "GC step pauses:                    ",
+        [GC_PAUSE_FULL] = "Full GC pauses:                    ",
+        [GC_PAUSE_CLEANUP] = "Sweep cleanup pauses:              ",
+    };
+    for (int kind = 0; kind < GC_PAUSE_KINDS_COUNT; kind++) {
+        const gc_pause_summary_t *summary = &stats->kinds[kind];
+        printf("%s %lu (p50 %luns, p90 %luns, p99 %luns, p99.9 %luns, max %luns)\n", names[kind],
+               (unsigned long) summary->count, (unsigned long) summary->p50_ns, (unsigned long) summary->p90_ns,
+               (unsigned long) summary->p99_ns, (unsigned long) summary->p999_ns, (unsigned long) summary->max_ns);
+    }
+    double fraction = stats->elapsed_ns > 0 ? (double) stats->total_gc_ns / (double) stats->elapsed_ns : 0.0;
+    printf("Total GC time:                      %.3f ms (%.2f%% of %.3f ms)\n",
+           stats->total_gc_ns / 1e6, fraction * 100.0, stats->elapsed_ns / 1e6);
+    for (int i = 0; i < stats->mmu_windows_count; i++) {
+        printf("MMU over %8.3f ms windows:       %.2f%%\n", stats->mmu_windows_ns[i] / 1e6, stats->mmu[i] * 100.0);
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef STELLA_GC_PAUSE_H
+#define STELLA_GC_PAUSE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** Histogram buckets: values below 16ns are exact, above that every power of two
+ * is split into 16 linear sub-buckets (at most ~6% error, like HdrHistogram with 1 significant digit).
+ */
+#define GC_HISTOGRAM_SUB_BUCKETS 16
+#define GC_HISTOGRAM_BUCKETS (61 * GC_HISTOGRAM_SUB_BUCKETS)
+
+/** Number of pauses kept for minimum mutator utilisation computation. */
+#define GC_PAUSE_LOG_SIZE (1 << 16)
+
+/** Maximum number of MMU windows that can be configured. */
+#define GC_MMU_MAX_WINDOWS 8
+
+/** Kinds of timed GC work. */
+typedef enum GC_PAUSE_KIND {
+    GC_PAUSE_STEP,      /**< incremental gc_step */
+    GC_PAUSE_FULL,      /**< non-incremental gc_full */
+    GC_PAUSE_CLEANUP,   /**< sweep_cleanup (nested in a step or a full collection) */
+    GC_PAUSE_KINDS_COUNT
+} GC_PAUSE_KIND;
+
+typedef struct gc_histogram_t {
+    uint64_t counts[GC_HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} gc_histogram_t;
+
+typedef struct gc_pause_record_t {
+    uint64_t start_ns;
+    uint64_t end_ns;
+} gc_pause_record_t;
+
+/** Per-heap pause bookkeeping, lives inside the GC instance. */
+typedef struct gc_pause_tracker_t {
+    gc_histogram_t histograms[GC_PAUSE_KINDS_COUNT];
+
+    // only the outermost timed region counts as a pause (cleanup runs inside a step)
+    int depth;
+    uint64_t start_ns;
+    uint64_t total_gc_ns;
+
+    // recent pauses for MMU
+    gc_pause_record_t *log;
+    uint64_t log_head;
+
+    int mmu_windows_count;
+    uint64_t mmu_windows_ns[GC_MMU_MAX_WINDOWS];
+} gc_pause_tracker_t;
+
+/** Latency summary of one kind of GC work. Percentiles are bucket upper bounds. */
+typedef struct gc_pause_summary_t {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+} gc_pause_summary_t;
+
+/** Pause-time and mutator utilisation metrics of the GC. */
+typedef struct gc_pause_stats_t {
+    gc_pause_summary_t kinds[GC_PAUSE_KINDS_COUNT];
+
+    uint64_t total_gc_ns;   /**< Time spent in GC pauses. */
+    uint64_t elapsed_ns;    /**< Time since GC initialisation. */
+
+    int mmu_windows_count;
+    uint64_t mmu_windows_ns[GC_MMU_MAX_WINDOWS];
+    double mmu[GC_MMU_MAX_WINDOWS]; /**< Minimum mutator utilisation (0..1) for each window. */
+} gc_pause_stats_t;
+
+uint64_t gc_clock_ns();
+
+void gc_pause_tracker_init(gc_pause_tracker_t *tracker);
+
+void gc_pause_tracker_free(gc_pause_tracker_t *tracker);
+
+/** Start timing a region, returns its start timestamp. */
+uint64_t gc_pause_begin(gc_pause_tracker_t *tracker);
+
+/** Finish timing a region started by gc_pause_begin. */
+void gc_pause_end(gc_pause_tracker_t *tracker, GC_PAUSE_KIND kind, uint64_t start_ns);
+
+void gc_pause_tracker_set_mmu_windows(gc_pause_tracker_t *tracker, const uint64_t *windows_ns, int count);
+
+void gc_pause_tracker_collect(const gc_pause_tracker_t *tracker, gc_pause_stats_t *stats);
+
+void gc_pause_stats_print(const gc_pause_stats_t *stats);
+
+/** Get pause-time statistics of the GC. */
+gc_pause_stats_t gc_get_pause_stats();
+
+/** Configure MMU window sizes in nanoseconds (at most GC_MMU_MAX_WINDOWS).
+ * Defaults are 1ms, 10ms and 100ms.
+ */
+void gc_set_mmu_windows(const uint64_t *windows_ns, int count);
+
+#endif
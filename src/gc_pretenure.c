@@ -0,0 +1,280 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "gc_internal.h"
+#include "gc_pretenure.h"
+
+static void check_site(int site) {
+    if (site < 0 || site >= GC_MAX_SITES) {
+        printf("Invalid allocation site %d\n", site);
+        exit(1);
+    }
+}
+
+static gc_site_t *site_of(int site) {
+    if (gc->sites == NULL) {
+        gc->sites = calloc(GC_MAX_SITES, sizeof(gc_site_t));
+        if (gc->sites == NULL) {
+            printf("Memory allocation for allocation sites failed!\n");
+            exit(1);
+        }
+    }
+    return &gc->sites[site];
+}
+
+void gc_site_alloc(int site, size_t size_in_bytes, bool mature) {
+    if (site == 0) {
+        return;
+    }
+    gc_site_t *s = site_of(site);
+    s->stats.allocated_objects += 1;
+    s->stats.allocated_bytes += size_in_bytes;
+    if (mature) {
+        s->stats.mature_objects += 1;
+    }
+}
+
+void gc_site_survive(int site, unsigned char age) {
+    if (site == 0) {
+        return;
+    }
+    if (age == 0) {
+        site_of(site)->next_objects += 1;
+    } else if (age == 1) {
+        site_of(site)->stats.survived_objects += 1;
+    }
+}
+
+void gc_pretenure_flip() {
+    if (gc->sites == NULL) {
+        return;
+    }
+    const double threshold = gc->pretenure_threshold;
+    for (int site = 1; site < GC_MAX_SITES; site++) {
+        gc_site_t *s = &gc->sites[site];
+        if (s->stats.allocated_objects == 0) {
+            continue;
+        }
+        // first-time survivors of the previous cycle have been judged, this cycle's ones are next
+        s->stats.collected_objects += s->cycle_objects;
+        s->cycle_objects = s->next_objects;
+        s->next_objects = 0;
+        if (threshold > 0 && !s->stats.pretenured && s->stats.collected_objects >= GC_PRETENURE_MIN_OBJECTS
+            && s->stats.survived_objects >= threshold * s->stats.collected_objects) {
+            s->stats.pretenured = true;
+        }
+    }
+}
+
+// free blocks are linked through forward, as offsets in words plus one from the start of the space
+static gc_object_t *next_free(gc_object_t *obj) {
+    return obj->forward == 0 ? NULL : gc->mature.start + (size_t) (obj->forward - 1) * GC_FORWARD_ALIGNMENT;
+}
+
+static void link_free(gc_object_t *obj, gc_object_t *next) {
+    obj->forward = next == NULL ? 0 : (uint32_t) (((void *) next - gc->mature.start) / GC_FORWARD_ALIGNMENT) + 1;
+}
+
+// a free block goes to the list of its size class, larger ones to the first-fit list
+static void free_block(gc_object_t *obj) {
+    gc_mature_space_t *mature = &gc->mature;
+    const size_t words = get_gc_object_size(obj) / sizeof(void *);
+    gc_object_t **list = words < GC_MATURE_SIZE_CLASSES ? &mature->free_lists[words] : &mature->large_free;
+    link_free(obj, *list);
+    *list = obj;
+}
+
+// first large free block which fits, the rest of it is covered with fillers and freed again
+static gc_object_t *take_large_free(size_t size_in_bytes) {
+    gc_mature_space_t *mature = &gc->mature;
+    gc_object_t *previous = NULL;
+    for (gc_object_t *obj = mature->large_free; obj != NULL; previous = obj, obj = next_free(obj)) {
+        const size_t size = get_gc_object_size(obj);
+        // a rest smaller than a header could not be walked
+        if (size < size_in_bytes || (size > size_in_bytes && size - size_in_bytes < sizeof(gc_object_t))) {
+            continue;
+        }
+        if (previous == NULL) {
+            mature->large_free = next_free(obj);
+        } else {
+            link_free(previous, next_free(obj));
+        }
+        void *rest = (void *) obj + size_in_bytes;
+        void *end = (void *) obj + size;
+        gc_fill_gap(rest, end);
+        for (void *p = rest; p < end; p += get_gc_object_size(p)) {
+            free_block(p);
+        }
+        // the block is walkable with its new size until the object is initialised
+        obj->obj.object_header = TAG_MASK | (int) ((size_in_bytes - sizeof(gc_object_t)) / sizeof(void *)) << 4;
+        return obj;
+    }
+    return NULL;
+}
+
+static void *mature_space_alloc(size_t size_in_bytes) {
+    gc_mature_space_t *mature = &gc->mature;
+    const size_t words = size_in_bytes / sizeof(void *);
+    if (words < GC_MATURE_SIZE_CLASSES && mature->free_lists[words] != NULL) {
+        gc_object_t *obj = mature->free_lists[words];
+        mature->free_lists[words] = next_free(obj);
+        mature->used_bytes += size_in_bytes;
+        return obj;
+    }
+    gc_object_t *reused = take_large_free(size_in_bytes);
+    if (reused != NULL) {
+        mature->used_bytes += size_in_bytes;
+        return reused;
+    }
+    if (mature->start == NULL) {
+        // reserved once, pages are only backed when touched
+        void *start = mmap(NULL, GC_MATURE_SPACE_RESERVE, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (start == MAP_FAILED) {
+            return NULL;
+        }
+        mature->start = start;
+        mature->top = start;
+        mature->end = start + GC_MATURE_SPACE_RESERVE;
+    }
+    if (size_in_bytes > (size_t) (mature->end - mature->top)) {
+        return NULL;
+    }
+    void *obj = mature->top;
+    mature->top += size_in_bytes;
+    mature->used_bytes += size_in_bytes;
+    return obj;
+}
+
+gc_object_t *gc_alloc_mature(size_t size_in_bytes, int site) {
+    if (gc_is_shared()) {
+        pthread_mutex_lock(&gc->lock);
+    }
+    gc_object_t *obj = mature_space_alloc(size_in_bytes);
+    if (obj != NULL) {
+        // only the allocation that succeeds pays a step, a failed one falls back to the heap which pays its own
+        if (gc_is_shared()) {
+            gc_mutator->steps_owed += 1;
+        }
+        obj->age = 0;
+        obj->flags = 0;
+        obj->site = site;
+        obj->forward = 0;
+        gc_update_stats_after_object_alloc(size_in_bytes);
+        gc_site_alloc(site, size_in_bytes, true);
+        // scanned once initialised while marking; while copying marking is over, so it is live already
+        if (gc->phase == MARK) {
+            obj->color = WHITE;
+            make_stella_object_grey_if_needed(&obj->obj);
+        } else {
+            obj->color = BLACK;
+        }
+    }
+    if (gc_is_shared()) {
+        pthread_mutex_unlock(&gc->lock);
+    }
+    return obj;
+}
+
+void sweep_mature_space() {
+    gc_mature_space_t *mature = &gc->mature;
+    for (void *p = mature->start; p < mature->top; p += get_gc_object_size(p)) {
+        gc_object_t *obj = p;
+        if (obj->color != BLACK) {
+            continue;
+        }
+        sweep_forward_fields(obj);
+    }
+}
+
+bool is_dead_at_flip(void *object) {
+    if (is_in_current_heap(object)) {
+        return true;
+    }
+    return gc_is_in_mature(object) && stella_object_to_gc_object(object)->color != BLACK;
+}
+
+void gc_mature_space_flip() {
+    gc_mature_space_t *mature = &gc->mature;
+    for (void *p = mature->start; p < mature->top; p += get_gc_object_size(p)) {
+        gc_object_t *obj = p;
+        if (obj->flags & GC_OBJECT_FILLER) {
+            continue;
+        }
+        if (obj->color == BLACK) {
+            obj->color = WHITE;
+            continue;
+        }
+        // unreachable, the block keeps its header so that the space stays walkable
+        const size_t size = get_gc_object_size(obj);
+        if (obj->site != 0) {
+            gc->sites[obj->site].stats.mature_dead_objects += 1;
+        }
+        obj->flags = GC_OBJECT_FILLER;
+        mature->used_bytes -= size;
+        free_block(obj);
+    }
+}
+
+void gc_pretenure_free() {
+    free(gc->sites);
+    gc->sites = NULL;
+    if (gc->mature.start != NULL) {
+        munmap(gc->mature.start, GC_MATURE_SPACE_RESERVE);
+    }
+    memset(&gc->mature, 0, sizeof(gc_mature_space_t));
+}
+
+void gc_set_pretenure_threshold(double threshold) {
+    gc_init();
+    gc->pretenure_threshold = threshold;
+}
+
+bool gc_get_site_stats(int site, gc_site_stats_t *stats) {
+    gc_init();
+    check_site(site);
+    gc_safepoint_begin();
+    bool found = gc->sites != NULL && gc->sites[site].stats.allocated_objects > 0;
+    if (found) {
+        *stats = gc->sites[site].stats;
+    }
+    gc_safepoint_end();
+    return found;
+}
+
+void print_gc_site_stats() {
+    gc_safepoint_begin();
+    printf("%-6s %12s %14s %12s %12s %7s %12s %12s %10s\n", "site", "objects", "bytes", "collected",
+           "survivors", "surv%", "mature", "mature dead", "pretenured");
+    for (int site = 1; gc->sites != NULL && site < GC_MAX_SITES; site++) {
+        const gc_site_stats_t *s = &gc->sites[site].stats;
+        if (s->allocated_objects == 0) {
+            continue;
+        }
+        double survival = s->collected_objects > 0
+                              ? 100.0 * (double) s->survived_objects / (double) s->collected_objects
+                              : 0.0;
+        printf("%-6d %12lu %14lu %12lu %12lu %6.1f%% %12lu %12lu %10s\n", site,
+               (unsigned long) s->allocated_objects, (unsigned long) s->allocated_bytes,
+               (unsigned long) s->collected_objects, (unsigned long) s->survived_objects, survival,
+               (unsigned long) s->mature_objects, (unsigned long) s->mature_dead_objects,
+               s->pretenured ? "yes" : "no");
+    }
+    printf("Mature space:                       %'lu bytes in use\n", (unsigned long) gc->mature.used_bytes);
+    gc_safepoint_end();
+}
+
+void gc_pretenure_configure_from_env() {
+    const char *value = getenv("STELLA_GC_PRETENURE");
+    if (value == NULL || *value == '\0') {
+        return;
+    }
+    double threshold = strcmp(value, "1") == 0 ? GC_PRETENURE_DEFAULT_THRESHOLD : atof(value);
+    if (threshold <= 0 || threshold > 1) {
+        printf("STELLA_GC_PRETENURE=%s is not a survival rate in (0, 1], pretenuring is off\n", value);
+        return;
+    }
+    gc->pretenure_threshold = threshold;
+}
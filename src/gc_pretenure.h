@@ -0,0 +1,57 @@
+#ifndef STELLA_GC_PRETENURE_H
+#define STELLA_GC_PRETENURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Allocation sites and pretenuring.
+ *
+ * An allocation site is a number in [1, GC_MAX_SITES) chosen by the caller (0 is "unknown"
+ * and is not tracked). The site is kept in the object's GC header, so the collector can tell
+ * at every copy which sites produce survivors. Objects allocated while marking are kept by that
+ * collection whatever happens to them, so a site is judged by how many of the objects which
+ * survived one collection survive the next one too.
+ * Once a site's survival rate reaches the pretenuring threshold, its objects are allocated in the
+ * mature space instead: objects there are marked like any other, but never copied, and dead ones
+ * are freed at every flip.
+ */
+#define GC_MAX_SITES 4096
+
+/** Site of runtime-built naturals (nat_to_stella_object), compiled code numbers its sites after it. */
+#define GC_SITE_RUNTIME_NAT 1
+
+/** A site is only judged once this many of its objects went through a collection. */
+#define GC_PRETENURE_MIN_OBJECTS 64
+
+/** Survival rate at or above which a site is pretenured when STELLA_GC_PRETENURE=1. */
+#define GC_PRETENURE_DEFAULT_THRESHOLD 0.9
+
+typedef struct gc_site_stats_t {
+    uint64_t allocated_objects;
+    uint64_t allocated_bytes;
+    uint64_t collected_objects;     /**< Survived their first collection and went through the next one. */
+    uint64_t survived_objects;      /**< Of those, survived the second one as well. */
+    uint64_t mature_objects;        /**< Allocated in the mature space. */
+    uint64_t mature_dead_objects;   /**< Freed from the mature space. */
+    bool pretenured;
+} gc_site_stats_t;
+
+/** gc_alloc for an object allocated at the given site. */
+void *gc_alloc_at_site(size_t size_in_bytes_for_stella, int site);
+
+/** Pretenure sites whose survival rate reaches threshold (in (0, 1]); 0 turns pretenuring off (default).
+ * Sites which are pretenured already stay so.
+ */
+void gc_set_pretenure_threshold(double threshold);
+
+/** Fill stats for a site, false if nothing has been allocated there. */
+bool gc_get_site_stats(int site, gc_site_stats_t *stats);
+
+/** Print allocation, survival and pretenuring decisions of every site in use. */
+void print_gc_site_stats();
+
+/** STELLA_GC_PRETENURE=1 enables pretenuring with the default threshold, STELLA_GC_PRETENURE=<rate> with a given one. */
+void gc_pretenure_configure_from_env();
+
+#endif
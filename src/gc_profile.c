@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gc_profile.h"
+
+static const char *const tag_names[GC_PROFILE_TAGS] = {
+    "ZERO", "SUCC", "FALSE", "TRUE", "FN", "REF", "UNIT", "TUPLE",
+    "INL", "INR", "EMPTY", "CONS", "NAT", "TAG_13", "TAG_14", "TAG_15",
+};
+
+const char *gc_tag_name(int tag) {
+    return tag_names[tag & (GC_PROFILE_TAGS - 1)];
+}
+
+void gc_tag_profile_init(gc_tag_profile_t *profile) {
+    memset(profile, 0, sizeof(gc_tag_profile_t));
+}
+
+void gc_tag_profile_alloc(gc_tag_profile_t *profile, int tag, uint64_t bytes) {
+    profile->allocated_objects[tag] += 1;
+    profile->allocated_bytes[tag] += bytes;
+    profile->cycle_objects[tag] += 1;
+}
+
+void gc_tag_profile_alloc_next(gc_tag_profile_t *profile, int tag, uint64_t bytes) {
+    gc_tag_profile_alloc(profile, tag, bytes);
+    profile->cycle_survivors[tag] += 1;
+}
+
+unsigned char gc_tag_profile_survive(gc_tag_profile_t *profile, int tag, uint64_t bytes, unsigned char age) {
+    unsigned char new_age = age == 255 ? age : age + 1;
+    profile->survived_objects[tag] += 1;
+    profile->survived_bytes[tag] += bytes;
+    profile->cycle_survivors[tag] += 1;
+    profile->cycle_survivors_age_sum[tag] += age;
+    profile->cycle_next_age_sum[tag] += new_age;
+    return new_age;
+}
+
+void gc_tag_profile_flip(gc_tag_profile_t *profile) {
+    for (int tag = 0; tag < GC_PROFILE_TAGS; tag++) {
+        // objects are only counted when their tag is known, survivors may outnumber them
+        if (profile->cycle_objects[tag] > profile->cycle_survivors[tag]) {
+            profile->dead_objects[tag] += profile->cycle_objects[tag] - profile->cycle_survivors[tag];
+        }
+        if (profile->cycle_age_sum[tag] > profile->cycle_survivors_age_sum[tag]) {
+            profile->dead_age_sum[tag] += profile->cycle_age_sum[tag] - profile->cycle_survivors_age_sum[tag];
+        }
+        profile->cycle_objects[tag] = profile->cycle_survivors[tag];
+        profile->cycle_age_sum[tag] = profile->cycle_next_age_sum[tag];
+        profile->cycle_survivors[tag] = 0;
+        profile->cycle_survivors_age_sum[tag] = 0;
+        profile->cycle_next_age_sum[tag] = 0;
+    }
+}
+
+static double percent(uint64_t part, uint64_t total) {
+    return total > 0 ? 100.0 * (double) part / (double) total : 0.0;
+}
+
+void gc_tag_profile_print(const gc_tag_profile_t *profile) {
+    uint64_t allocated_bytes = 0, survived_bytes = 0;
+    for (int tag = 0; tag < GC_PROFILE_TAGS; tag++) {
+        allocated_bytes += profile->allocated_bytes[tag];
+        survived_bytes += profile->survived_bytes[tag];
+    }
+    printf("%-8s %12s %14s %7s %12s %14s %7s %12s %9s\n", "tag", "objects", "bytes", "alloc%",
+           "survivors", "survived bytes", "surv%", "deaths", "death age");
+    for (int tag = 0; tag < GC_PROFILE_TAGS; tag++) {
+        if (profile->allocated_objects[tag] == 0 && profile->survived_objects[tag] == 0) {
+            continue;
+        }
+        double death_age = profile->dead_objects[tag] > 0
+                               ? (double) profile->dead_age_sum[tag] / (double) profile->dead_objects[tag]
+                               : 0.0;
+        printf("%-8s %12lu %14lu %6.1f%% %12lu %14lu %6.1f%% %12lu %9.2f\n", tag_names[tag],
+               (unsigned long) profile->allocated_objects[tag], (unsigned long) profile->allocated_bytes[tag],
+               percent(profile->allocated_bytes[tag], allocated_bytes),
+               (unsigned long) profile->survived_objects[tag], (unsigned long) profile->survived_bytes[tag],
+               percent(profile->survived_bytes[tag], survived_bytes),
+               (unsigned long) profile->dead_objects[tag], death_age);
+    }
+    // headline: the tag whose share of survivors exceeds its share of allocation the most
+    int worst = -1;
+    double worst_excess = 0.0;
+    for (int tag = 0; tag < GC_PROFILE_TAGS; tag++) {
+        double excess = percent(profile->survived_bytes[tag], survived_bytes)
+                        - percent(profile->allocated_bytes[tag], allocated_bytes);
+        if (profile->survived_bytes[tag] > 0 && excess > worst_excess) {
+            worst = tag;
+            worst_excess = excess;
+        }
+    }
+    if (worst >= 0) {
+        printf("%s objects are %.1f%% of allocated bytes but %.1f%% of survived bytes\n", tag_names[worst],
+               percent(profile->allocated_bytes[worst], allocated_bytes),
+               percent(profile->survived_bytes[worst], survived_bytes));
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef STELLA_GC_PROFILE_H
+#define STELLA_GC_PROFILE_H
+
+#include <stdint.h>
+
+/** Number of distinct tags that fit into a Stella object header. */
+#define GC_PROFILE_TAGS 16
+
+/** Per-tag allocation and survival counters.
+ * Age is the number of collections an object has survived.
+ */
+typedef struct gc_tag_profile_t {
+    uint64_t allocated_objects[GC_PROFILE_TAGS];
+    uint64_t allocated_bytes[GC_PROFILE_TAGS];
+    uint64_t survived_objects[GC_PROFILE_TAGS];   /**< Copies done by the collector (one per object per cycle). */
+    uint64_t survived_bytes[GC_PROFILE_TAGS];
+    uint64_t dead_objects[GC_PROFILE_TAGS];
+    uint64_t dead_age_sum[GC_PROFILE_TAGS];
+
+    // population of the current from-space, settled at every flip
+    uint64_t cycle_objects[GC_PROFILE_TAGS];
+    uint64_t cycle_age_sum[GC_PROFILE_TAGS];
+    uint64_t cycle_survivors[GC_PROFILE_TAGS];
+    uint64_t cycle_survivors_age_sum[GC_PROFILE_TAGS];
+    uint64_t cycle_next_age_sum[GC_PROFILE_TAGS];
+} gc_tag_profile_t;
+
+/** Short name of a Stella object tag ("SUCC", "CONS", ...). */
+const char *gc_tag_name(int tag);
+
+void gc_tag_profile_init(gc_tag_profile_t *profile);
+
+void gc_tag_profile_alloc(gc_tag_profile_t *profile, int tag, uint64_t bytes);
+
+/** Record an allocation made directly in to-space, it already belongs to the next cycle. */
+void gc_tag_profile_alloc_next(gc_tag_profile_t *profile, int tag, uint64_t bytes);
+
+/** Record a copy of an object of the given age (before the copy). Returns the new age. */
+unsigned char gc_tag_profile_survive(gc_tag_profile_t *profile, int tag, uint64_t bytes, unsigned char age);
+
+/** Settle deaths of the cycle that has just finished. */
+void gc_tag_profile_flip(gc_tag_profile_t *profile);
+
+void gc_tag_profile_print(const gc_tag_profile_t *profile);
+
+/** Print per-tag allocation and survival statistics of the GC. */
+void print_gc_tag_profile();
+
+#endif
@@ -0,0 +1,248 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gc_record.h"
+#include "gc_weak.h"
+
+#define RECORD_BUFFER_SIZE (1 << 20)
+// opcode and three 64-bit LEB128 operands
+#define RECORD_MAX_EVENT_SIZE 31
+
+typedef struct gc_recorder_t {
+    FILE *out;
+    unsigned char *buffer;
+    size_t used;
+
+    uint64_t next_id;
+    // object -> id, re-keyed by the collector as objects move
+    gc_weak_map_t ids;
+
+    // last value id reported for each root
+    uint64_t *root_ids;
+    size_t root_ids_capacity;
+    size_t roots_depth;
+} gc_recorder_t;
+
+bool gc_record_enabled = false;
+
+static gc_recorder_t recorder;
+static bool recorder_at_exit = false;
+
+static void record_flush() {
+    if (recorder.used > 0) {
+        fwrite(recorder.buffer, 1, recorder.used, recorder.out);
+        recorder.used = 0;
+    }
+}
+
+static void put_varint(uint64_t value) {
+    while (value >= 0x80) {
+        recorder.buffer[recorder.used++] = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+    recorder.buffer[recorder.used++] = (unsigned char) value;
+}
+
+static void put_event(GC_RECORD_OP op, int args_count, uint64_t a, uint64_t b, uint64_t c) {
+    if (recorder.used + RECORD_MAX_EVENT_SIZE > RECORD_BUFFER_SIZE) {
+        record_flush();
+    }
+    recorder.buffer[recorder.used++] = op;
+    if (args_count > 0) { put_varint(a); }
+    if (args_count > 1) { put_varint(b); }
+    if (args_count > 2) { put_varint(c); }
+}
+
+static uint64_t object_id(void *object) {
+    uint64_t id;
+    if (object != NULL && gc_weak_map_get(&recorder.ids, object, &id)) {
+        return id;
+    }
+    return 0;
+}
+
+static void set_root_id(size_t index, uint64_t id) {
+    if (index >= recorder.root_ids_capacity) {
+        size_t capacity = recorder.root_ids_capacity == 0 ? 256 : recorder.root_ids_capacity;
+        while (capacity <= index) {
+            capacity *= 2;
+        }
+        uint64_t *root_ids = realloc(recorder.root_ids, capacity * sizeof(uint64_t));
+        if (root_ids == NULL) {
+            printf("Memory allocation for GC recorder failed!\n");
+            exit(1);
+        }
+        memset(root_ids + recorder.root_ids_capacity, 0, (capacity - recorder.root_ids_capacity) * sizeof(uint64_t));
+        recorder.root_ids = root_ids;
+        recorder.root_ids_capacity = capacity;
+    }
+    recorder.root_ids[index] = id;
+}
+
+bool gc_record_start(const char *path) {
+    if (gc_record_enabled) {
+        gc_record_stop();
+    }
+    memset(&recorder, 0, sizeof(recorder));
+    recorder.out = fopen(path, "wb");
+    if (recorder.out == NULL) {
+        printf("Failed to open GC record file %s\n", path);
+        return false;
+    }
+    recorder.buffer = malloc(RECORD_BUFFER_SIZE);
+    if (recorder.buffer == NULL) {
+        printf("Memory allocation for GC recorder failed!\n");
+        fclose(recorder.out);
+        return false;
+    }
+    uint32_t version = GC_RECORD_VERSION, flags = 0;
+    fwrite(GC_RECORD_MAGIC, 1, 8, recorder.out);
+    fwrite(&version, sizeof(version), 1, recorder.out);
+    fwrite(&flags, sizeof(flags), 1, recorder.out);
+    recorder.next_id = 1;
+    gc_weak_map_init(&recorder.ids, NULL, NULL, NULL);
+    gc_register_weak_map(&recorder.ids);
+    gc_record_enabled = true;
+    return true;
+}
+
+void gc_record_stop() {
+    if (!gc_record_enabled) {
+        return;
+    }
+    gc_record_enabled = false;
+    record_flush();
+    fclose(recorder.out);
+    gc_unregister_weak_map(&recorder.ids);
+    gc_weak_map_free(&recorder.ids);
+    free(recorder.buffer);
+    free(recorder.root_ids);
+    memset(&recorder, 0, sizeof(recorder));
+}
+
+void gc_record_configure_from_env() {
+    const char *path = getenv("STELLA_GC_RECORD");
+    if (path == NULL || *path == '\0' || recorder_at_exit) {
+        return;
+    }
+    if (gc_record_start(path)) {
+        recorder_at_exit = true;
+        atexit(gc_record_stop);
+    }
+}
+
+void gc_record_alloc(void *object, int tag, int fields_count) {
+    gc_weak_put(&recorder.ids, object, recorder.next_id++);
+    put_event(GC_RECORD_ALLOC, 2, tag, fields_count, 0);
+}
+
+void gc_record_init(void *object, int field_index, void *contents) {
+    put_event(GC_RECORD_INIT, 3, object_id(object), field_index, object_id(contents));
+}
+
+void gc_record_write(void *object, int field_index, void *contents) {
+    put_event(GC_RECORD_WRITE, 3, object_id(object), field_index, object_id(contents));
+}
+
+void gc_record_read(void *object, int field_index) {
+    put_event(GC_RECORD_READ, 2, object_id(object), field_index, 0);
+}
+
+void gc_record_push_root(void *contents) {
+    uint64_t id = object_id(contents);
+    set_root_id(recorder.roots_depth++, id);
+    put_event(GC_RECORD_PUSH_ROOT, 1, id, 0, 0);
+}
+
+void gc_record_pop_root() {
+    if (recorder.roots_depth > 0) {
+        recorder.roots_depth--;
+    }
+    put_event(GC_RECORD_POP_ROOT, 0, 0, 0, 0);
+}
+
+void gc_record_sync_roots(void ***roots, int roots_count) {
+    for (int i = 0; i < roots_count && (size_t) i < recorder.roots_depth; i++) {
+        uint64_t id = object_id(*roots[i]);
+        if (recorder.root_ids[i] != id) {
+            recorder.root_ids[i] = id;
+            put_event(GC_RECORD_ROOT_SET, 2, i, id, 0);
+        }
+    }
+}
+
+bool gc_record_reader_open(gc_record_reader_t *reader, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Failed to open GC record file %s\n", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 16) {
+        printf("%s is not a GC record file\n", path);
+        close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("Failed to map GC record file %s\n", path);
+        return false;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    uint32_t version;
+    memcpy(&version, (const unsigned char *) data + 8, sizeof(version));
+    if (memcmp(data, GC_RECORD_MAGIC, 8) != 0 || version != GC_RECORD_VERSION) {
+        printf("%s is not a GC record file\n", path);
+        munmap(data, st.st_size);
+        return false;
+    }
+    reader->data = data;
+    reader->size = st.st_size;
+    reader->position = 16;
+    return true;
+}
+
+void gc_record_reader_close(gc_record_reader_t *reader) {
+    munmap((void *) reader->data, reader->size);
+    reader->data = NULL;
+}
+
+static bool get_varint(gc_record_reader_t *reader, uint64_t *value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && reader->position < reader->size; shift += 7) {
+        unsigned char byte = reader->data[reader->position++];
+        result |= (uint64_t) (byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool gc_record_reader_next(gc_record_reader_t *reader, gc_record_event_t *event) {
+    static const int args_count[] = {
+        [GC_RECORD_ALLOC] = 2, [GC_RECORD_INIT] = 3, [GC_RECORD_WRITE] = 3, [GC_RECORD_READ] = 2,
+        [GC_RECORD_PUSH_ROOT] = 1, [GC_RECORD_POP_ROOT] = 0, [GC_RECORD_ROOT_SET] = 2,
+    };
+    if (reader->position >= reader->size) {
+        return false;
+    }
+    unsigned char op = reader->data[reader->position++];
+    if (op < GC_RECORD_ALLOC || op > GC_RECORD_ROOT_SET) {
+        return false;
+    }
+    event->op = op;
+    for (int i = 0; i < args_count[op]; i++) {
+        if (!get_varint(reader, &event->args[i])) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,71 @@
+#ifndef STELLA_GC_RECORD_H
+#define STELLA_GC_RECORD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/** Allocation/mutation trace file layout:
+ *
+ *   "SGCTRACE", uint32_t version, uint32_t flags
+ *   events: one opcode byte followed by LEB128-encoded operands
+ *
+ * Objects are identified by their allocation number (starting at 1), 0 stands for
+ * anything that is not a heap object (static objects, function pointers, garbage).
+ */
+#define GC_RECORD_MAGIC "SGCTRACE"
+#define GC_RECORD_VERSION 1
+
+typedef enum GC_RECORD_OP {
+    GC_RECORD_ALLOC = 1,    /**< tag, fields count; the new object gets the next id */
+    GC_RECORD_INIT,         /**< object, field, value */
+    GC_RECORD_WRITE,        /**< object, field, value */
+    GC_RECORD_READ,         /**< object, field */
+    GC_RECORD_PUSH_ROOT,    /**< value currently stored in the pushed root */
+    GC_RECORD_POP_ROOT,
+    GC_RECORD_ROOT_SET,     /**< root index, value; emitted when the collector scans roots */
+} GC_RECORD_OP;
+
+typedef struct gc_record_event_t {
+    GC_RECORD_OP op;
+    uint64_t args[3];
+} gc_record_event_t;
+
+/** Whether recording is on, checked inline by the barrier macros. */
+extern bool gc_record_enabled;
+
+/** Start recording GC API calls to a trace file at path.
+ * The recorder is process-wide, record single-context (single-thread) runs only.
+ */
+bool gc_record_start(const char *path);
+
+/** Flush and close the trace. */
+void gc_record_stop();
+
+/** Record into STELLA_GC_RECORD=<file> if it is set, the trace is closed at exit. */
+void gc_record_configure_from_env();
+
+void gc_record_alloc(void *object, int tag, int fields_count);
+void gc_record_init(void *object, int field_index, void *contents);
+void gc_record_write(void *object, int field_index, void *contents);
+void gc_record_read(void *object, int field_index);
+void gc_record_push_root(void *contents);
+void gc_record_pop_root();
+/** Emit ROOT_SET for roots whose value changed since the last scan. */
+void gc_record_sync_roots(void ***roots, int roots_count);
+
+/** Sequential reader over a memory-mapped trace. */
+typedef struct gc_record_reader_t {
+    const unsigned char *data;
+    size_t size;
+    size_t position;
+} gc_record_reader_t;
+
+bool gc_record_reader_open(gc_record_reader_t *reader, const char *path);
+
+void gc_record_reader_close(gc_record_reader_t *reader);
+
+/** Decode the next event, returns false at the end of the trace (or on a malformed event). */
+bool gc_record_reader_next(gc_record_reader_t *reader, gc_record_event_t *event);
+
+#endif
@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gc_internal.h"
+#include "gc_trace.h"
+#include "gc_roots.h"
+
+void gc_root_stack_init(gc_root_stack_t *stack, gc_t *context) {
+    memset(stack, 0, sizeof(gc_root_stack_t));
+    stack->context = context;
+}
+
+void gc_root_stack_free(gc_root_stack_t *stack) {
+    free(stack->roots);
+    stack->roots = NULL;
+    stack->roots_cont = 0;
+    stack->capacity = 0;
+}
+
+void gc_root_stack_grow(gc_root_stack_t *stack) {
+    int capacity = stack->capacity == 0 ? GC_ROOT_STACK_INITIAL_CAPACITY : stack->capacity * 2;
+    stella_object ***roots = realloc(stack->roots, capacity * sizeof(stella_object **));
+    if (roots == NULL) {
+        printf("Memory allocation for GC root stack failed!\n");
+        exit(1);
+    }
+    stack->roots = roots;
+    stack->capacity = capacity;
+}
+
+static gc_root_stack_t **suspended_list(gc_root_stack_t *stack) {
+    return stack->scanned ? &gc->scanned_root_stacks : &gc->pending_root_stacks;
+}
+
+static void suspend(gc_root_stack_t *stack, bool scanned) {
+    stack->suspended = true;
+    stack->scanned = scanned;
+    gc_root_stack_t **list = suspended_list(stack);
+    stack->prev = NULL;
+    stack->next = *list;
+    if (*list != NULL) {
+        (*list)->prev = stack;
+    }
+    *list = stack;
+}
+
+static void resume(gc_root_stack_t *stack) {
+    if (stack->prev != NULL) {
+        stack->prev->next = stack->next;
+    } else {
+        *suspended_list(stack) = stack->next;
+    }
+    if (stack->next != NULL) {
+        stack->next->prev = stack->prev;
+    }
+    stack->suspended = false;
+    stack->prev = NULL;
+    stack->next = NULL;
+}
+
+// suspended stacks are only touched by the collector while other mutators are stopped
+static void lock_if_shared() {
+    if (gc_is_shared()) {
+        pthread_mutex_lock(&gc->lock);
+    }
+}
+
+static void unlock_if_shared() {
+    if (gc_is_shared()) {
+        pthread_mutex_unlock(&gc->lock);
+    }
+}
+
+gc_root_stack_t *gc_root_stack_create() {
+    gc_init();
+    gc_root_stack_t *stack = malloc(sizeof(gc_root_stack_t));
+    if (stack == NULL) {
+        printf("Memory allocation for GC root stack failed!\n");
+        exit(1);
+    }
+    gc_root_stack_init(stack, gc);
+    lock_if_shared();
+    // nothing to scan in an empty stack
+    suspend(stack, true);
+    unlock_if_shared();
+    return stack;
+}
+
+gc_root_stack_t *gc_root_stack_switch(gc_root_stack_t *stack) {
+    gc_init();
+    gc_root_stack_t *previous = gc_mutator->stack;
+    if (stack == previous) {
+        return previous;
+    }
+    if (stack->context != gc || !stack->suspended) {
+        printf("Root stack %p is active or belongs to another GC context\n", (void *) stack);
+        exit(1);
+    }
+    lock_if_shared();
+    resume(stack);
+    // the previous stack may have changed since it was last scanned
+    suspend(previous, false);
+    gc_mutator->stack = stack;
+    unlock_if_shared();
+    return previous;
+}
+
+void gc_root_stack_destroy(gc_root_stack_t *stack) {
+    if (stack == NULL) {
+        return;
+    }
+    if (!stack->suspended) {
+        printf("Root stack %p is active and cannot be destroyed\n", (void *) stack);
+        exit(1);
+    }
+    gc_t *previous = gc;
+    gc = stack->context;
+    lock_if_shared();
+    resume(stack);
+    unlock_if_shared();
+    gc = previous;
+    gc_root_stack_free(stack);
+    free(stack);
+}
+
+void gc_visit_root_stacks(void (*visit)(gc_root_stack_t *stack, void *data), void *data) {
+    for (gc_mutator_t *mutator = gc->mutators; mutator != NULL; mutator = mutator->next) {
+        visit(mutator->stack, data);
+    }
+    for (gc_root_stack_t *stack = gc->pending_root_stacks; stack != NULL; stack = stack->next) {
+        visit(stack, data);
+    }
+    for (gc_root_stack_t *stack = gc->scanned_root_stacks; stack != NULL; stack = stack->next) {
+        visit(stack, data);
+    }
+}
+
+bool mark_next_suspended_root_stack() {
+    gc_root_stack_t *stack = gc->pending_root_stacks;
+    if (stack == NULL) {
+        return false;
+    }
+    GC_TRACE(GC_TRACE_ROOT_SCAN, GC_TRACE_BEGIN, stack->roots_cont);
+    for (int i = 0; i < stack->roots_cont; i++) {
+        make_stella_object_grey_if_needed(*(stack->roots[i]));
+    }
+    GC_TRACE(GC_TRACE_ROOT_SCAN, GC_TRACE_END, stack->roots_cont);
+    resume(stack);
+    suspend(stack, true);
+    return true;
+}
+
+void gc_root_stacks_flip() {
+    while (gc->scanned_root_stacks != NULL) {
+        gc_root_stack_t *stack = gc->scanned_root_stacks;
+        resume(stack);
+        suspend(stack, false);
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef STELLA_GC_ROOTS_H
+#define STELLA_GC_ROOTS_H
+
+/** A separate stack of GC roots, for evaluations run as coroutines on one thread.
+ *
+ * gc_push_root and gc_pop_root work on the calling thread's active root stack. A host
+ * which interleaves many evaluations creates a root stack for each of them and switches
+ * to it whenever it resumes the evaluation. Stacks grow as needed.
+ *
+ * The collector scans suspended stacks incrementally, one per step, and only once per
+ * collection cycle: they cannot change until they are switched to again.
+ */
+typedef struct gc_root_stack_t gc_root_stack_t;
+
+/** Create an empty suspended root stack on the calling thread's context. */
+gc_root_stack_t *gc_root_stack_create();
+
+/** Make stack the calling thread's active root stack, the previous one is suspended and returned.
+ * The stack must belong to the thread's context and must not be active on another thread.
+ */
+gc_root_stack_t *gc_root_stack_switch(gc_root_stack_t *stack);
+
+/** Free a suspended root stack. Objects reachable only from its roots become garbage. */
+void gc_root_stack_destroy(gc_root_stack_t *stack);
+
+#endif
@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <execinfo.h>
+
+#include "gc_sample.h"
+#include "gc_profile.h"
+
+// frames of gc_sampler_take and gc_object_allocated
+#define SKIPPED_FRAMES 2
+
+static bool sample_on_move(gc_weak_map_t *map, uint64_t *value, void *from, void *to) {
+    gc_alloc_sampler_t *sampler = map->data;
+    sampler->samples[*value].survived = true;
+    // nothing more to learn about this object
+    return false;
+}
+
+void gc_sampler_init(gc_alloc_sampler_t *sampler) {
+    memset(sampler, 0, sizeof(gc_alloc_sampler_t));
+    gc_weak_map_init(&sampler->live, sample_on_move, NULL, sampler);
+}
+
+void gc_sampler_free(gc_alloc_sampler_t *sampler) {
+    free(sampler->samples);
+    free(sampler->stacks);
+    free(sampler->stacks_index);
+    gc_weak_map_free(&sampler->live);
+    gc_sampler_init(sampler);
+}
+
+static uint64_t next_random(gc_alloc_sampler_t *sampler) {
+    uint64_t x = sampler->random_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    sampler->random_state = x;
+    return x;
+}
+
+// uniform in [1, 2 * interval], so that the mean distance between samples is interval
+static void schedule_next_sample(gc_alloc_sampler_t *sampler) {
+    sampler->bytes_until_sample = (int64_t) (next_random(sampler) % (2 * sampler->interval) + 1);
+}
+
+void gc_sampler_start(gc_alloc_sampler_t *sampler, uint64_t interval) {
+    sampler->enabled = true;
+    sampler->interval = interval > 0 ? interval : GC_SAMPLE_DEFAULT_INTERVAL;
+    sampler->random_state = 0x9e3779b97f4a7c15ull ^ (uint64_t) (uintptr_t) sampler;
+    schedule_next_sample(sampler);
+}
+
+static uint64_t hash_stack(const gc_sample_stack_t *stack) {
+    uint64_t h = 1469598103934665603ull;
+    for (int i = 0; i < stack->depth; i++) {
+        h = (h ^ (uint64_t) (uintptr_t) stack->frames[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+static void *grow(void *array, size_t *capacity, size_t element_size) {
+    size_t new_capacity = *capacity == 0 ? 64 : *capacity * 2;
+    void *result = realloc(array, new_capacity * element_size);
+    if (result == NULL) {
+        printf("Memory allocation for allocation samples failed!\n");
+        exit(1);
+    }
+    *capacity = new_capacity;
+    return result;
+}
+
+static void index_stack(gc_alloc_sampler_t *sampler, uint32_t stack) {
+    size_t mask = sampler->stacks_index_capacity - 1;
+    size_t slot = hash_stack(&sampler->stacks[stack]) & mask;
+    while (sampler->stacks_index[slot] != UINT32_MAX) {
+        slot = (slot + 1) & mask;
+    }
+    sampler->stacks_index[slot] = stack;
+}
+
+static void rebuild_stacks_index(gc_alloc_sampler_t *sampler) {
+    free(sampler->stacks_index);
+    sampler->stacks_index_capacity = sampler->stacks_capacity * 2;
+    sampler->stacks_index = malloc(sampler->stacks_index_capacity * sizeof(uint32_t));
+    if (sampler->stacks_index == NULL) {
+        printf("Memory allocation for allocation samples failed!\n");
+        exit(1);
+    }
+    memset(sampler->stacks_index, 0xff, sampler->stacks_index_capacity * sizeof(uint32_t));
+    for (size_t i = 0; i < sampler->stacks_count; i++) {
+        index_stack(sampler, i);
+    }
+}
+
+static uint32_t intern_stack(gc_alloc_sampler_t *sampler, const gc_sample_stack_t *stack) {
+    if (sampler->stacks_index != NULL) {
+        size_t mask = sampler->stacks_index_capacity - 1;
+        size_t slot = hash_stack(stack) & mask;
+        while (sampler->stacks_index[slot] != UINT32_MAX) {
+            const gc_sample_stack_t *known = &sampler->stacks[sampler->stacks_index[slot]];
+            if (known->depth == stack->depth && memcmp(known->frames, stack->frames, stack->depth * sizeof(void *)) == 0) {
+                return sampler->stacks_index[slot];
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+    if (sampler->stacks_count == sampler->stacks_capacity) {
+        sampler->stacks = grow(sampler->stacks, &sampler->stacks_capacity, sizeof(gc_sample_stack_t));
+        // index is kept at twice the capacity of stacks
+        sampler->stacks[sampler->stacks_count++] = *stack;
+        rebuild_stacks_index(sampler);
+    } else {
+        sampler->stacks[sampler->stacks_count++] = *stack;
+        index_stack(sampler, sampler->stacks_count - 1);
+    }
+    return sampler->stacks_count - 1;
+}
+
+size_t gc_sampler_take(gc_alloc_sampler_t *sampler, int tag, uint64_t size) {
+    void *frames[GC_SAMPLE_MAX_FRAMES + SKIPPED_FRAMES];
+    gc_sample_stack_t stack;
+    int depth = backtrace(frames, GC_SAMPLE_MAX_FRAMES + SKIPPED_FRAMES);
+    stack.depth = depth > SKIPPED_FRAMES ? depth - SKIPPED_FRAMES : 0;
+    memcpy(stack.frames, frames + SKIPPED_FRAMES, stack.depth * sizeof(void *));
+
+    if (sampler->samples_count == sampler->samples_capacity) {
+        sampler->samples = grow(sampler->samples, &sampler->samples_capacity, sizeof(gc_sample_t));
+    }
+    gc_sample_t *sample = &sampler->samples[sampler->samples_count];
+    sample->stack = intern_stack(sampler, &stack);
+    sample->tag = tag;
+    sample->size = size;
+    sample->survived = false;
+    schedule_next_sample(sampler);
+    return sampler->samples_count++;
+}
+
+// "binary(function+0x1a) [0x...]" -> "function", unknown symbols keep the address
+static void frame_name(const char *symbol, void *address, char *out, size_t out_size) {
+    const char *open = strchr(symbol, '(');
+    if (open != NULL) {
+        const char *end = open + 1;
+        while (*end != '\0' && *end != '+' && *end != ')') {
+            end++;
+        }
+        if (end > open + 1) {
+            size_t length = end - open - 1;
+            if (length >= out_size) {
+                length = out_size - 1;
+            }
+            memcpy(out, open + 1, length);
+            out[length] = '\0';
+            return;
+        }
+    }
+    snprintf(out, out_size, "%p", address);
+}
+
+static int compare_samples(const void *a, const void *b) {
+    const gc_sample_t *x = a, *y = b;
+    if (x->stack != y->stack) { return x->stack < y->stack ? -1 : 1; }
+    if (x->tag != y->tag) { return x->tag < y->tag ? -1 : 1; }
+    return (int) x->survived - (int) y->survived;
+}
+
+bool gc_sampler_write_folded(const gc_alloc_sampler_t *sampler, FILE *out) {
+    gc_sample_t *sorted = malloc((sampler->samples_count + 1) * sizeof(gc_sample_t));
+    if (sorted == NULL) {
+        return false;
+    }
+    memcpy(sorted, sampler->samples, sampler->samples_count * sizeof(gc_sample_t));
+    qsort(sorted, sampler->samples_count, sizeof(gc_sample_t), compare_samples);
+
+    char name[256];
+    size_t i = 0;
+    while (i < sampler->samples_count) {
+        // every sample stands for interval bytes of allocation, bigger objects for themselves
+        uint64_t weight = 0;
+        size_t j = i;
+        while (j < sampler->samples_count && compare_samples(&sorted[i], &sorted[j]) == 0) {
+            weight += sorted[j].size > sampler->interval ? sorted[j].size : sampler->interval;
+            j++;
+        }
+        const gc_sample_stack_t *stack = &sampler->stacks[sorted[i].stack];
+        char **symbols = backtrace_symbols(stack->frames, stack->depth);
+        for (int frame = stack->depth - 1; frame >= 0; frame--) {
+            frame_name(symbols != NULL ? symbols[frame] : "", stack->frames[frame], name, sizeof(name));
+            fprintf(out, "%s;", name);
+        }
+        free(symbols);
+        fprintf(out, "%s;%s %lu\n", gc_tag_name(sorted[i].tag), sorted[i].survived ? "survived" : "died",
+                (unsigned long) weight);
+        i = j;
+    }
+    free(sorted);
+    return !ferror(out);
+}
+
+static char *profile_exit_path = NULL;
+
+static void gc_write_alloc_profile_at_exit() {
+    gc_write_alloc_profile(profile_exit_path);
+}
+
+void gc_sampler_configure_from_env() {
+    const char *path = getenv("STELLA_GC_ALLOC_PROFILE");
+    if (path == NULL || *path == '\0' || profile_exit_path != NULL) {
+        return;
+    }
+    uint64_t interval = GC_SAMPLE_DEFAULT_INTERVAL;
+    const char *interval_env = getenv("STELLA_GC_ALLOC_SAMPLE_BYTES");
+    if (interval_env != NULL && atol(interval_env) > 0) {
+        interval = atol(interval_env);
+    }
+    profile_exit_path = malloc(strlen(path) + 1);
+    strcpy(profile_exit_path, path);
+    gc_start_alloc_sampling(interval);
+    atexit(gc_write_alloc_profile_at_exit);
+}
@@ -0,0 +1,83 @@
+#ifndef STELLA_GC_SAMPLE_H
+#define STELLA_GC_SAMPLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "gc_weak.h"
+
+/** Default mean distance between allocation samples, in bytes. */
+#define GC_SAMPLE_DEFAULT_INTERVAL (512 * 1024)
+
+/** Maximum number of frames captured per sample. */
+#define GC_SAMPLE_MAX_FRAMES 32
+
+typedef struct gc_sample_stack_t {
+    int depth;
+    void *frames[GC_SAMPLE_MAX_FRAMES];
+} gc_sample_stack_t;
+
+typedef struct gc_sample_t {
+    uint32_t stack;
+    uint32_t tag;
+    uint64_t size;
+    bool survived;      /**< The sampled object survived at least one collection. */
+} gc_sample_t;
+
+/** Sampling allocation profiler. Every interval bytes (on average, randomised) the call stack of an
+ * allocation is captured, the object is then tracked through a weak map to find out whether it survives.
+ */
+typedef struct gc_alloc_sampler_t {
+    bool enabled;
+    uint64_t interval;
+    int64_t bytes_until_sample;
+    uint64_t random_state;
+
+    gc_sample_t *samples;
+    size_t samples_count;
+    size_t samples_capacity;
+
+    // deduplicated stacks with an open addressing index over them
+    gc_sample_stack_t *stacks;
+    size_t stacks_count;
+    size_t stacks_capacity;
+    uint32_t *stacks_index;
+    size_t stacks_index_capacity;
+
+    // sampled objects which have not been through a collection yet -> sample index
+    gc_weak_map_t live;
+} gc_alloc_sampler_t;
+
+void gc_sampler_init(gc_alloc_sampler_t *sampler);
+
+void gc_sampler_free(gc_alloc_sampler_t *sampler);
+
+void gc_sampler_start(gc_alloc_sampler_t *sampler, uint64_t interval);
+
+/** Account an allocation, returns true if it must be sampled. */
+static inline bool gc_sampler_should_sample(gc_alloc_sampler_t *sampler, uint64_t size) {
+    sampler->bytes_until_sample -= (int64_t) size;
+    return sampler->bytes_until_sample <= 0;
+}
+
+/** Capture the current call stack for an object, returns the new sample index. */
+size_t gc_sampler_take(gc_alloc_sampler_t *sampler, int tag, uint64_t size);
+
+/** Write samples in folded stack format ("root;...;leaf;TAG;survived|died bytes"),
+ * accepted by flamegraph.pl, speedscope and `pprof -raw`-style converters.
+ */
+bool gc_sampler_write_folded(const gc_alloc_sampler_t *sampler, FILE *out);
+
+/** Start sampling allocations of the GC every interval bytes on average. */
+void gc_start_alloc_sampling(uint64_t interval);
+
+/** Write the allocation profile to path in folded stack format. */
+bool gc_write_alloc_profile(const char *path);
+
+/** If STELLA_GC_ALLOC_PROFILE=<file> is set, sample allocations and write the profile to <file> at exit.
+ * STELLA_GC_ALLOC_SAMPLE_BYTES overrides the sampling interval.
+ */
+void gc_sampler_configure_from_env();
+
+#endif
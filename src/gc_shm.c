@@ -0,0 +1,65 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "gc_shm.h"
+
+gc_shm_page_t *gc_shm_map(const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("Failed to open GC stats page %s\n", path);
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(gc_shm_page_t)) != 0) {
+        printf("Failed to resize GC stats page %s\n", path);
+        close(fd);
+        return NULL;
+    }
+    gc_shm_page_t *page = mmap(NULL, sizeof(gc_shm_page_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        printf("Failed to map GC stats page %s\n", path);
+        return NULL;
+    }
+    page->version = GC_SHM_VERSION;
+    page->pid = getpid();
+    atomic_store_explicit(&page->seq, 0, memory_order_relaxed);
+    // readers check magic last, publish it after everything else is in place
+    atomic_thread_fence(memory_order_release);
+    page->magic = GC_SHM_MAGIC;
+    return page;
+}
+
+void gc_shm_unmap(gc_shm_page_t *page) {
+    munmap(page, sizeof(gc_shm_page_t));
+}
+
+void gc_shm_publish(gc_shm_page_t *page, const gc_shm_sample_t *sample) {
+    uint64_t seq = atomic_load_explicit(&page->seq, memory_order_relaxed);
+    atomic_store_explicit(&page->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&page->timestamp_ns, sample->timestamp_ns, memory_order_relaxed);
+    atomic_store_explicit(&page->total_allocated_bytes, sample->total_allocated_bytes, memory_order_relaxed);
+    atomic_store_explicit(&page->total_allocated_objects, sample->total_allocated_objects, memory_order_relaxed);
+    atomic_store_explicit(&page->live_bytes, sample->live_bytes, memory_order_relaxed);
+    atomic_store_explicit(&page->max_live_bytes, sample->max_live_bytes, memory_order_relaxed);
+    atomic_store_explicit(&page->heap_size, sample->heap_size, memory_order_relaxed);
+    atomic_store_explicit(&page->phase, sample->phase, memory_order_relaxed);
+    atomic_store_explicit(&page->mark_phase_count, sample->mark_phase_count, memory_order_relaxed);
+    atomic_store_explicit(&page->sweep_phase_count, sample->sweep_phase_count, memory_order_relaxed);
+    atomic_store_explicit(&page->total_reads, sample->total_reads, memory_order_relaxed);
+    atomic_store_explicit(&page->total_writes, sample->total_writes, memory_order_relaxed);
+    atomic_store_explicit(&page->total_gc_ns, sample->total_gc_ns, memory_order_relaxed);
+    atomic_store_explicit(&page->max_pause_ns, sample->max_pause_ns, memory_order_relaxed);
+    atomic_store_explicit(&page->seq, seq + 2, memory_order_release);
+}
+
+void gc_shm_configure_from_env() {
+    const char *path = getenv("STELLA_GC_SHM");
+    if (path != NULL && *path != '\0') {
+        gc_shm_open(path);
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef STELLA_GC_SHM_H
+#define STELLA_GC_SHM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define GC_SHM_MAGIC 0x53474353u /* "SGCS" */
+#define GC_SHM_VERSION 1
+
+/** Live GC counters published to a memory-mapped file, so that external tools (gc-top)
+ * can watch a running process. Writers bump seq to an odd value, store the fields and
+ * bump it back to even; readers retry while seq is odd or changed during the read.
+ */
+typedef struct gc_shm_page_t {
+    uint32_t magic;
+    uint32_t version;
+    int64_t pid;
+    _Atomic uint64_t seq;
+
+    _Atomic uint64_t timestamp_ns;          /**< Monotonic time of the last publish. */
+    _Atomic uint64_t total_allocated_bytes;
+    _Atomic uint64_t total_allocated_objects;
+    _Atomic uint64_t live_bytes;            /**< Live bytes after the last flip. */
+    _Atomic uint64_t max_live_bytes;
+    _Atomic uint64_t heap_size;
+    _Atomic uint64_t phase;                 /**< 0 is mark, 1 is sweep. */
+    _Atomic uint64_t mark_phase_count;
+    _Atomic uint64_t sweep_phase_count;
+    _Atomic uint64_t total_reads;
+    _Atomic uint64_t total_writes;
+    _Atomic uint64_t total_gc_ns;
+    _Atomic uint64_t max_pause_ns;
+} gc_shm_page_t;
+
+/** Plain copy of the published counters. */
+typedef struct gc_shm_sample_t {
+    uint64_t timestamp_ns;
+    uint64_t total_allocated_bytes;
+    uint64_t total_allocated_objects;
+    uint64_t live_bytes;
+    uint64_t max_live_bytes;
+    uint64_t heap_size;
+    uint64_t phase;
+    uint64_t mark_phase_count;
+    uint64_t sweep_phase_count;
+    uint64_t total_reads;
+    uint64_t total_writes;
+    uint64_t total_gc_ns;
+    uint64_t max_pause_ns;
+} gc_shm_sample_t;
+
+/** Create (or truncate) the file at path and publish GC counters into it.
+ * Returns false if the file cannot be created or mapped.
+ */
+bool gc_shm_open(const char *path);
+
+/** Stop publishing and unmap the page. The file is left in place. */
+void gc_shm_close();
+
+/** Call gc_shm_open with STELLA_GC_SHM=<file> if it is set. */
+void gc_shm_configure_from_env();
+
+/** Map the file at path as a fresh page, NULL on failure. */
+gc_shm_page_t *gc_shm_map(const char *path);
+
+void gc_shm_unmap(gc_shm_page_t *page);
+
+/** Publish a sample into the page (seqlock write side). */
+void gc_shm_publish(gc_shm_page_t *page, const gc_shm_sample_t *sample);
+
+/** Read a consistent sample from the page (seqlock read side). */
+static inline void gc_shm_read(gc_shm_page_t *page, gc_shm_sample_t *sample) {
+    uint64_t before, after;
+    do {
+        before = atomic_load_explicit(&page->seq, memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        sample->timestamp_ns = atomic_load_explicit(&page->timestamp_ns, memory_order_relaxed);
+        sample->total_allocated_bytes = atomic_load_explicit(&page->total_allocated_bytes, memory_order_relaxed);
+        sample->total_allocated_objects = atomic_load_explicit(&page->total_allocated_objects, memory_order_relaxed);
+        sample->live_bytes = atomic_load_explicit(&page->live_bytes, memory_order_relaxed);
+        sample->max_live_bytes = atomic_load_explicit(&page->max_live_bytes, memory_order_relaxed);
+        sample->heap_size = atomic_load_explicit(&page->heap_size, memory_order_relaxed);
+        sample->phase = atomic_load_explicit(&page->phase, memory_order_relaxed);
+        sample->mark_phase_count = atomic_load_explicit(&page->mark_phase_count, memory_order_relaxed);
+        sample->sweep_phase_count = atomic_load_explicit(&page->sweep_phase_count, memory_order_relaxed);
+        sample->total_reads = atomic_load_explicit(&page->total_reads, memory_order_relaxed);
+        sample->total_writes = atomic_load_explicit(&page->total_writes, memory_order_relaxed);
+        sample->total_gc_ns = atomic_load_explicit(&page->total_gc_ns, memory_order_relaxed);
+        sample->max_pause_ns = atomic_load_explicit(&page->max_pause_ns, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&page->seq, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+}
+
+#endif
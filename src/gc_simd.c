@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "gc_simd.h"
+
+// a field is in range if its distance from start, as an unsigned number, is below size
+static uint64_t fields_in_range_scalar(void *const *fields, int count, uintptr_t start, uintptr_t size) {
+    uint64_t mask = 0;
+    for (int i = 0; i < count; i++) {
+        mask |= (uint64_t) ((uintptr_t) fields[i] - start < size) << i;
+    }
+    return mask;
+}
+
+#if defined(__x86_64__)
+// there is no unsigned 64-bit comparison, flipping the sign bit turns it into a signed one
+
+__attribute__((target("sse4.2")))
+static uint64_t fields_in_range_sse42(void *const *fields, int count, uintptr_t start, uintptr_t size) {
+    const __m128i sign = _mm_set1_epi64x(INT64_MIN);
+    const __m128i base = _mm_set1_epi64x((long long) start);
+    const __m128i limit = _mm_xor_si128(_mm_set1_epi64x((long long) size), sign);
+    uint64_t mask = 0;
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i offset = _mm_sub_epi64(_mm_loadu_si128((const __m128i *) (fields + i)), base);
+        __m128i below = _mm_cmpgt_epi64(limit, _mm_xor_si128(offset, sign));
+        mask |= (uint64_t) _mm_movemask_pd(_mm_castsi128_pd(below)) << i;
+    }
+    if (i < count) {
+        mask |= fields_in_range_scalar(fields + i, count - i, start, size) << i;
+    }
+    return mask;
+}
+
+__attribute__((target("avx2")))
+static uint64_t fields_in_range_avx2(void *const *fields, int count, uintptr_t start, uintptr_t size) {
+    const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+    const __m256i base = _mm256_set1_epi64x((long long) start);
+    const __m256i limit = _mm256_xor_si256(_mm256_set1_epi64x((long long) size), sign);
+    uint64_t mask = 0;
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i offset = _mm256_sub_epi64(_mm256_loadu_si256((const __m256i *) (fields + i)), base);
+        __m256i below = _mm256_cmpgt_epi64(limit, _mm256_xor_si256(offset, sign));
+        mask |= (uint64_t) _mm256_movemask_pd(_mm256_castsi256_pd(below)) << i;
+    }
+    if (i < count) {
+        mask |= fields_in_range_scalar(fields + i, count - i, start, size) << i;
+    }
+    return mask;
+}
+#endif
+
+typedef struct kernel_t {
+    const char *name;
+    gc_fields_kernel_t function;
+} kernel_t;
+
+static kernel_t chosen = {"scalar", fields_in_range_scalar};
+static pthread_once_t chosen_once = PTHREAD_ONCE_INIT;
+
+static void choose_kernel() {
+    const char *requested = getenv("STELLA_GC_SIMD");
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    const bool has_avx2 = __builtin_cpu_supports("avx2");
+    const bool has_sse42 = __builtin_cpu_supports("sse4.2");
+    if (requested != NULL && strcmp(requested, "scalar") == 0) {
+        // as initialised
+    } else if (requested != NULL && strcmp(requested, "sse4.2") == 0 && has_sse42) {
+        chosen = (kernel_t) {"sse4.2", fields_in_range_sse42};
+    } else if (has_avx2) {
+        chosen = (kernel_t) {"avx2", fields_in_range_avx2};
+    } else if (has_sse42) {
+        chosen = (kernel_t) {"sse4.2", fields_in_range_sse42};
+    }
+#else
+    (void) requested;
+#endif
+    atomic_store(&gc_fields_kernel, chosen.function);
+}
+
+// the first call picks the kernel, later ones go to it directly
+static uint64_t fields_in_range_first_call(void *const *fields, int count, uintptr_t start, uintptr_t size) {
+    pthread_once(&chosen_once, choose_kernel);
+    return chosen.function(fields, count, start, size);
+}
+
+_Atomic gc_fields_kernel_t gc_fields_kernel = fields_in_range_first_call;
+
+const char *gc_simd_kernel_name() {
+    pthread_once(&chosen_once, choose_kernel);
+    return chosen.name;
+}
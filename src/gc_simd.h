@@ -0,0 +1,40 @@
+#ifndef STELLA_GC_SIMD_H
+#define STELLA_GC_SIMD_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/** Field classification for tracing and forwarding.
+ *
+ * gc_fields_in_range compares up to 64 fields of an object against an address range at once
+ * and returns a bitmask of the fields pointing into it, so that the collector only looks at
+ * fields it has to grey or forward. Objects with fewer than GC_SIMD_MIN_FIELDS fields are
+ * classified inline; wider ones go to a vector kernel (AVX2 or SSE4.2 on x86-64, chosen at
+ * the first call from what the CPU supports) or to the scalar one.
+ * STELLA_GC_SIMD=scalar|sse4.2|avx2 picks a kernel explicitly, an unsupported one falls back
+ * to the best available.
+ */
+#define GC_SIMD_MIN_FIELDS 4
+
+typedef uint64_t (*gc_fields_kernel_t)(void *const *fields, int count, uintptr_t start, uintptr_t size);
+
+extern _Atomic gc_fields_kernel_t gc_fields_kernel;
+
+/** Name of the kernel in use, choosing it if that has not been done yet. */
+const char *gc_simd_kernel_name();
+
+/** Bit i is set if fields[i] is in [start, end); only the first 64 fields are classified. */
+static inline uint64_t gc_fields_in_range(void *const *fields, int count, const void *start, const void *end) {
+    const uintptr_t size = (uintptr_t) end - (uintptr_t) start;
+    if (count < GC_SIMD_MIN_FIELDS) {
+        uint64_t mask = 0;
+        for (int i = 0; i < count; i++) {
+            mask |= (uint64_t) ((uintptr_t) fields[i] - (uintptr_t) start < size) << i;
+        }
+        return mask;
+    }
+    const gc_fields_kernel_t kernel = atomic_load_explicit(&gc_fields_kernel, memory_order_relaxed);
+    return kernel(fields, count > 64 ? 64 : count, (uintptr_t) start, size);
+}
+
+#endif
@@ -0,0 +1,88 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gc_internal.h"
+#include "gc_snapshot.h"
+
+static void count_roots(gc_root_stack_t *stack, void *data) {
+    *(uint64_t *) data += stack->roots_cont;
+}
+
+static void write_roots(gc_root_stack_t *stack, void *data) {
+    for (int i = 0; i < stack->roots_cont; i++) {
+        uint64_t root = (uint64_t) (uintptr_t) *(stack->roots[i]);
+        fwrite(&root, sizeof(root), 1, data);
+    }
+}
+
+// objects in [start, end), free blocks and fillers are skipped
+static uint64_t count_objects(void *start, void *end) {
+    uint64_t count = 0;
+    for (void *p = start; p < end; p += get_gc_object_size(p)) {
+        if (!(((gc_object_t *) p)->flags & GC_OBJECT_FILLER)) {
+            count += 1;
+        }
+    }
+    return count;
+}
+
+static void write_objects(FILE *out, void *start, void *end) {
+    for (void *p = start; p < end; p += get_gc_object_size(p)) {
+        gc_object_t *object = p;
+        if (object->flags & GC_OBJECT_FILLER) {
+            continue;
+        }
+        gc_snapshot_object_t record;
+        record.address = (uint64_t) (uintptr_t) &object->obj;
+        record.header = object->obj.object_header;
+        record.size = get_gc_object_size(object);
+        // raw limbs of naturals are not references
+        record.field_count = STELLA_OBJECT_HEADER_POINTER_COUNT(object->obj.object_header);
+        record.age = object->age;
+        fwrite(&record, sizeof(record), 1, out);
+        for (uint32_t i = 0; i < record.field_count; i++) {
+            uint64_t field = (uint64_t) (uintptr_t) object->obj.object_fields[i];
+            fwrite(&field, sizeof(field), 1, out);
+        }
+    }
+}
+
+bool gc_dump_heap_snapshot(const char *path) {
+    gc_init();
+    gc_safepoint_begin();
+    // objects in TLABs are handed to the collector, the rest of the buffers become fillers
+    gc_mutators_flush();
+    gc_mutators_retire_tlabs();
+    // the heap can only be walked linearly between collections
+    while (gc->phase == SWEEP) {
+        gc_step();
+    }
+    FILE *out = fopen(path, "wb");
+    if (out == NULL) {
+        printf("Failed to open heap snapshot file %s\n", path);
+        gc_safepoint_end();
+        return false;
+    }
+
+    gc_snapshot_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GC_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = GC_SNAPSHOT_VERSION;
+    header.pointer_size = sizeof(void *);
+    header.heap_start = (uint64_t) (uintptr_t) gc->current_heap;
+    header.heap_end = (uint64_t) (uintptr_t) gc->next_place_in_heap;
+    gc_visit_root_stacks(count_roots, &header.roots_count);
+    header.objects_count = count_objects(gc->current_heap, gc->next_place_in_heap) +
+                           count_objects(gc->mature.start, gc->mature.top);
+    fwrite(&header, sizeof(header), 1, out);
+
+    write_objects(out, gc->current_heap, gc->next_place_in_heap);
+    // pretenured objects are never copied, edges through them must not be lost
+    write_objects(out, gc->mature.start, gc->mature.top);
+
+    gc_visit_root_stacks(write_roots, out);
+    gc_safepoint_end();
+    bool ok = !ferror(out);
+    return fclose(out) == 0 && ok;
+}
@@ -0,0 +1,42 @@
+#ifndef STELLA_GC_SNAPSHOT_H
+#define STELLA_GC_SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Heap snapshot file layout (native byte order):
+ *
+ *   gc_snapshot_header_t
+ *   objects_count times: gc_snapshot_object_t followed by field_count uint64_t field values
+ *   roots_count times: uint64_t address of the object stored in the root
+ *
+ * Addresses are those of Stella objects (not GC headers). A field is an edge
+ * iff its value is the address of some object in the snapshot.
+ */
+#define GC_SNAPSHOT_MAGIC "SGCSNAP1"
+#define GC_SNAPSHOT_VERSION 1
+
+typedef struct gc_snapshot_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t pointer_size;
+    uint64_t heap_start;
+    uint64_t heap_end;
+    uint64_t objects_count;
+    uint64_t roots_count;
+} gc_snapshot_header_t;
+
+typedef struct gc_snapshot_object_t {
+    uint64_t address;
+    uint32_t header;        /**< Raw Stella object header (tag and field count). */
+    uint32_t size;          /**< Bytes taken in the heap, including the GC header. */
+    uint32_t field_count;
+    uint32_t age;
+} gc_snapshot_object_t;
+
+/** Write a snapshot of the current heap and the mature space to path. An unfinished sweep phase
+ * is completed first, so that the heap can be walked linearly. Returns false on I/O error.
+ */
+bool gc_dump_heap_snapshot(const char *path);
+
+#endif
@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "gc.h"
+
+#define MAX_STATS_FIELDS 64
+
+typedef struct gc_stats_field_t {
+    char name[40];
+    bool is_ratio;
+    unsigned long value;
+    double ratio;
+} gc_stats_field_t;
+
+static char *stats_exit_path = NULL;
+static GC_STATS_FORMAT stats_exit_format = GC_STATS_JSON;
+
+static void add_field(gc_stats_field_t *fields, int *count, const char *name, unsigned long value) {
+    gc_stats_field_t *field = &fields[(*count)++];
+    snprintf(field->name, sizeof(field->name), "%s", name);
+    field->is_ratio = false;
+    field->value = value;
+}
+
+static void add_ratio(gc_stats_field_t *fields, int *count, const char *name, double ratio) {
+    gc_stats_field_t *field = &fields[(*count)++];
+    snprintf(field->name, sizeof(field->name), "%s", name);
+    field->is_ratio = true;
+    field->ratio = ratio;
+}
+
+// flat list of name/value pairs shared by all output formats
+static int collect_fields(const gc_stats_snapshot_t *stats, gc_stats_field_t *fields) {
+    static const char *const pause_names[GC_PAUSE_KINDS_COUNT] = {
+        [GC_PAUSE_STEP] = "step",
+        [GC_PAUSE_FULL] = "full",
+        [GC_PAUSE_CLEANUP] = "cleanup",
+    };
+    char name[40];
+    int count = 0;
+    add_field(fields, &count, "total_allocated_bytes", stats->total_allocated_bytes);
+    add_field(fields, &count, "total_allocated_objects", stats->total_allocated_objects);
+    add_field(fields, &count, "max_residency_bytes", stats->max_residency_bytes);
+    add_field(fields, &count, "max_residency_objects", stats->max_residency_objects);
+    add_field(fields, &count, "last_residency_bytes", stats->last_residency_bytes);
+    add_field(fields, &count, "last_residency_objects", stats->last_residency_objects);
+    add_field(fields, &count, "current_allocated_bytes", stats->current_allocated_bytes);
+    add_field(fields, &count, "current_allocated_objects", stats->current_allocated_objects);
+    add_field(fields, &count, "total_reads", stats->total_reads);
+    add_field(fields, &count, "total_writes", stats->total_writes);
+    add_field(fields, &count, "gc_roots_max_size", stats->gc_roots_max_size);
+    add_field(fields, &count, "mark_steps", stats->mark_steps);
+    add_field(fields, &count, "sweep_steps", stats->sweep_steps);
+    add_field(fields, &count, "mark_phase_count", stats->mark_phase_count);
+    add_field(fields, &count, "sweep_phase_count", stats->sweep_phase_count);
+    add_field(fields, &count, "marked_objects", stats->marked_objects);
+    add_field(fields, &count, "heap_size", stats->heap_size);
+    add_field(fields, &count, "phase", stats->phase);
+    for (int kind = 0; kind < GC_PAUSE_KINDS_COUNT; kind++) {
+        const gc_pause_summary_t *summary = &stats->pauses.kinds[kind];
+        snprintf(name, sizeof(name), "%s_pauses", pause_names[kind]);
+        add_field(fields, &count, name, summary->count);
+        snprintf(name, sizeof(name), "%s_pause_total_ns", pause_names[kind]);
+        add_field(fields, &count, name, summary->total_ns);
+        snprintf(name, sizeof(name), "%s_pause_p50_ns", pause_names[kind]);
+        add_field(fields, &count, name, summary->p50_ns);
+        snprintf(name, sizeof(name), "%s_pause_p90_ns", pause_names[kind]);
+        add_field(fields, &count, name, summary->p90_ns);
+        snprintf(name, sizeof(name), "%s_pause_p99_ns", pause_names[kind]);
+        add_field(fields, &count, name, summary->p99_ns);
+        snprintf(name, sizeof(name), "%s_pause_p999_ns", pause_names[kind]);
+        add_field(fields, &count, name, summary->p999_ns);
+        snprintf(name, sizeof(name), "%s_pause_max_ns", pause_names[kind]);
+        add_field(fields, &count, name, summary->max_ns);
+    }
+    add_field(fields, &count, "total_gc_ns", stats->pauses.total_gc_ns);
+    add_field(fields, &count, "elapsed_ns", stats->pauses.elapsed_ns);
+    for (int i = 0; i < stats->pauses.mmu_windows_count; i++) {
+        snprintf(name, sizeof(name), "mmu_%luus", (unsigned long) (stats->pauses.mmu_windows_ns[i] / 1000));
+        add_ratio(fields, &count, name, stats->pauses.mmu[i]);
+    }
+    return count;
+}
+
+bool gc_export_stats(int fd, GC_STATS_FORMAT format) {
+    gc_stats_snapshot_t stats;
+    gc_stats_field_t fields[MAX_STATS_FIELDS];
+    gc_get_stats(&stats);
+    int count = collect_fields(&stats, fields);
+    int failed = 0;
+
+    switch (format) {
+        case GC_STATS_JSON:
+            failed |= dprintf(fd, "{") < 0;
+            for (int i = 0; i < count; i++) {
+                if (fields[i].is_ratio) {
+                    failed |= dprintf(fd, "%s\"%s\":%.6f", i ? "," : "", fields[i].name, fields[i].ratio) < 0;
+                } else {
+                    failed |= dprintf(fd, "%s\"%s\":%lu", i ? "," : "", fields[i].name, fields[i].value) < 0;
+                }
+            }
+            failed |= dprintf(fd, "}\n") < 0;
+            break;
+        case GC_STATS_CSV:
+            for (int i = 0; i < count; i++) {
+                failed |= dprintf(fd, "%s%s", i ? "," : "", fields[i].name) < 0;
+            }
+            failed |= dprintf(fd, "\n") < 0;
+            for (int i = 0; i < count; i++) {
+                if (fields[i].is_ratio) {
+                    failed |= dprintf(fd, "%s%.6f", i ? "," : "", fields[i].ratio) < 0;
+                } else {
+                    failed |= dprintf(fd, "%s%lu", i ? "," : "", fields[i].value) < 0;
+                }
+            }
+            failed |= dprintf(fd, "\n") < 0;
+            break;
+    }
+    return !failed;
+}
+
+static void gc_export_stats_at_exit() {
+    int fd = open(stats_exit_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("Failed to open GC stats file %s\n", stats_exit_path);
+        return;
+    }
+    gc_export_stats(fd, stats_exit_format);
+    close(fd);
+}
+
+void gc_stats_configure_from_env() {
+    const char *path = getenv("STELLA_GC_STATS_FILE");
+    if (path == NULL || *path == '\0' || stats_exit_path != NULL) {
+        return;
+    }
+    const char *format = getenv("STELLA_GC_STATS_FORMAT");
+    if (format != NULL && strcmp(format, "csv") == 0) {
+        stats_exit_format = GC_STATS_CSV;
+    }
+    stats_exit_path = malloc(strlen(path) + 1);
+    strcpy(stats_exit_path, path);
+    atexit(gc_export_stats_at_exit);
+}
@@ -0,0 +1,147 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gc_trace.h"
+#include "gc_pause.h"
+
+typedef struct gc_trace_entry_t {
+    uint64_t timestamp_ns;
+    uint64_t arg;
+    uint32_t thread;
+    uint8_t event;
+    uint8_t kind;
+} gc_trace_entry_t;
+
+bool gc_trace_enabled = false;
+
+static gc_trace_entry_t *trace_buffer = NULL;
+static size_t trace_mask = 0;
+static _Atomic uint64_t trace_head = 0;
+static uint64_t trace_start_ns = 0;
+
+static _Atomic uint32_t trace_thread_counter = 0;
+static _Thread_local uint32_t trace_thread_id = 0;
+
+static char *trace_exit_path = NULL;
+
+static const char *const trace_event_names[GC_TRACE_EVENTS_COUNT] = {
+    [GC_TRACE_MARK_PHASE] = "mark",
+    [GC_TRACE_SWEEP_PHASE] = "sweep",
+    [GC_TRACE_STEP] = "step",
+    [GC_TRACE_ROOT_SCAN] = "root scan",
+    [GC_TRACE_FULL_GC] = "full gc",
+    [GC_TRACE_FLIP] = "flip",
+    [GC_TRACE_HEAP_RESIZE] = "heap resize",
+};
+
+void gc_trace_record(GC_TRACE_EVENT event, GC_TRACE_KIND kind, uint64_t arg) {
+    if (trace_thread_id == 0) {
+        trace_thread_id = atomic_fetch_add_explicit(&trace_thread_counter, 1, memory_order_relaxed) + 1;
+    }
+    uint64_t index = atomic_fetch_add_explicit(&trace_head, 1, memory_order_relaxed);
+    gc_trace_entry_t *entry = &trace_buffer[index & trace_mask];
+    entry->timestamp_ns = gc_clock_ns();
+    entry->arg = arg;
+    entry->thread = trace_thread_id;
+    entry->event = event;
+    entry->kind = kind;
+}
+
+void gc_trace_enable(size_t capacity) {
+    size_t rounded = 1;
+    while (rounded < capacity) {
+        rounded <<= 1;
+    }
+    gc_trace_enabled = false;
+    free(trace_buffer);
+    trace_buffer = calloc(rounded, sizeof(gc_trace_entry_t));
+    if (trace_buffer == NULL) {
+        printf("Memory allocation for GC trace buffer failed!\n");
+        return;
+    }
+    trace_mask = rounded - 1;
+    atomic_store(&trace_head, 0);
+    trace_start_ns = gc_clock_ns();
+    gc_trace_enabled = true;
+}
+
+void gc_trace_disable() {
+    gc_trace_enabled = false;
+}
+
+bool gc_trace_dump(FILE *out) {
+    uint64_t head = atomic_load(&trace_head);
+    uint64_t count = head < trace_mask + 1 ? head : trace_mask + 1;
+    // ring buffer may have dropped the begin of a span, skip ends without a begin
+    int depth[GC_TRACE_EVENTS_COUNT] = {0};
+    bool first = true;
+    int pid = getpid();
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (uint64_t i = head - count; trace_buffer != NULL && i < head; i++) {
+        const gc_trace_entry_t *entry = &trace_buffer[i & trace_mask];
+        const char *phase;
+        switch (entry->kind) {
+            case GC_TRACE_BEGIN:
+                depth[entry->event] += 1;
+                phase = "B";
+                break;
+            case GC_TRACE_END:
+                if (depth[entry->event] == 0) {
+                    continue;
+                }
+                depth[entry->event] -= 1;
+                phase = "E";
+                break;
+            default:
+                phase = "i";
+                break;
+        }
+        double ts_us = (double) (entry->timestamp_ns - trace_start_ns) / 1000.0;
+        fprintf(out, "%s\n{\"name\":\"%s\",\"cat\":\"gc\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u",
+                first ? "" : ",", trace_event_names[entry->event], phase, ts_us, pid, entry->thread);
+        if (entry->kind == GC_TRACE_INSTANT) {
+            fprintf(out, ",\"s\":\"t\",\"args\":{\"value\":%llu}", (unsigned long long) entry->arg);
+        }
+        fprintf(out, "}");
+        first = false;
+    }
+    fprintf(out, "\n]}\n");
+    return !ferror(out);
+}
+
+bool gc_trace_dump_file(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        printf("Failed to open GC trace file %s\n", path);
+        return false;
+    }
+    bool ok = gc_trace_dump(out);
+    return fclose(out) == 0 && ok;
+}
+
+static void gc_trace_dump_at_exit() {
+    gc_trace_disable();
+    gc_trace_dump_file(trace_exit_path);
+}
+
+void gc_trace_configure_from_env() {
+    const char *path = getenv("STELLA_GC_TRACE");
+    if (path == NULL || *path == '\0' || trace_exit_path != NULL) {
+        return;
+    }
+    size_t capacity = GC_TRACE_DEFAULT_CAPACITY;
+    const char *capacity_env = getenv("STELLA_GC_TRACE_CAPACITY");
+    if (capacity_env != NULL && atol(capacity_env) > 0) {
+        capacity = atol(capacity_env);
+    }
+    trace_exit_path = malloc(strlen(path) + 1);
+    strcpy(trace_exit_path, path);
+    gc_trace_enable(capacity);
+    atexit(gc_trace_dump_at_exit);
+}
@@ -0,0 +1,60 @@
+#ifndef STELLA_GC_TRACE_H
+#define STELLA_GC_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** Default number of events kept in the trace ring buffer. */
+#define GC_TRACE_DEFAULT_CAPACITY (1 << 16)
+
+/** Events recorded by the GC tracer. */
+typedef enum GC_TRACE_EVENT {
+    GC_TRACE_MARK_PHASE,    /**< Mark phase (begin/end). */
+    GC_TRACE_SWEEP_PHASE,   /**< Sweep (copying) phase (begin/end). */
+    GC_TRACE_STEP,          /**< One incremental gc_step (begin/end). */
+    GC_TRACE_ROOT_SCAN,     /**< Scan of the root stack (begin/end). */
+    GC_TRACE_FULL_GC,       /**< Non-incremental gc_full fallback (begin/end). */
+    GC_TRACE_FLIP,          /**< Semispace flip (instant), argument is the live bytes. */
+    GC_TRACE_HEAP_RESIZE,   /**< New heap size chosen (instant), argument is the new size. */
+    GC_TRACE_EVENTS_COUNT
+} GC_TRACE_EVENT;
+
+typedef enum GC_TRACE_KIND {
+    GC_TRACE_BEGIN,
+    GC_TRACE_END,
+    GC_TRACE_INSTANT,
+} GC_TRACE_KIND;
+
+/** Whether tracing is on. Checked inline by GC_TRACE, so disabled tracing costs one branch. */
+extern bool gc_trace_enabled;
+
+#define GC_TRACE(event, kind, arg) do { if (gc_trace_enabled) { gc_trace_record(event, kind, arg); } } while (0)
+
+/** Append an event to the ring buffer. When the buffer is full the oldest events are overwritten.
+ * Safe to call from several threads at once.
+ */
+void gc_trace_record(GC_TRACE_EVENT event, GC_TRACE_KIND kind, uint64_t arg);
+
+/** Start tracing into a ring buffer of (at least) capacity events.
+ */
+void gc_trace_enable(size_t capacity);
+
+/** Stop tracing. Already recorded events are kept until the next gc_trace_enable.
+ */
+void gc_trace_disable();
+
+/** Write recorded events as Chrome trace JSON (viewable in Perfetto or chrome://tracing).
+ * Returns false on I/O error.
+ */
+bool gc_trace_dump(FILE *out);
+
+/** Same as gc_trace_dump, but to the file at path. */
+bool gc_trace_dump_file(const char *path);
+
+/** Enable tracing if STELLA_GC_TRACE=<file> is set; the trace is written to <file> at exit.
+ * STELLA_GC_TRACE_CAPACITY may override the ring buffer size.
+ */
+void gc_trace_configure_from_env();
+
+#endif
@@ -0,0 +1,147 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gc_weak.h"
+
+#define WEAK_MAP_MIN_CAPACITY 64
+
+static size_t hash_pointer(const void *key, size_t capacity) {
+    uint64_t h = (uint64_t) (uintptr_t) key;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h & (capacity - 1);
+}
+
+static void weak_map_resize(gc_weak_map_t *map, size_t capacity) {
+    gc_weak_entry_t *old_entries = map->entries;
+    size_t old_capacity = map->capacity;
+    map->entries = calloc(capacity, sizeof(gc_weak_entry_t));
+    if (map->entries == NULL) {
+        printf("Memory allocation for weak map failed!\n");
+        exit(1);
+    }
+    map->capacity = capacity;
+    map->count = 0;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_entries[i].key != NULL) {
+            gc_weak_map_put(map, old_entries[i].key, old_entries[i].value);
+        }
+    }
+    free(old_entries);
+}
+
+void gc_weak_map_init(gc_weak_map_t *map,
+                      bool (*on_move)(gc_weak_map_t *, uint64_t *, void *, void *),
+                      void (*on_death)(gc_weak_map_t *, uint64_t, void *),
+                      void *data) {
+    map->entries = NULL;
+    map->capacity = 0;
+    map->count = 0;
+    map->on_move = on_move;
+    map->on_death = on_death;
+    map->data = data;
+}
+
+void gc_weak_map_free(gc_weak_map_t *map) {
+    free(map->entries);
+    map->entries = NULL;
+    map->capacity = 0;
+    map->count = 0;
+}
+
+void gc_weak_map_put(gc_weak_map_t *map, void *key, uint64_t value) {
+    if ((map->count + 1) * 2 > map->capacity) {
+        weak_map_resize(map, map->capacity < WEAK_MAP_MIN_CAPACITY ? WEAK_MAP_MIN_CAPACITY : map->capacity * 2);
+    }
+    size_t i = hash_pointer(key, map->capacity);
+    while (map->entries[i].key != NULL && map->entries[i].key != key) {
+        i = (i + 1) & (map->capacity - 1);
+    }
+    if (map->entries[i].key == NULL) {
+        map->count += 1;
+    }
+    map->entries[i].key = key;
+    map->entries[i].value = value;
+}
+
+static gc_weak_entry_t *weak_map_find(const gc_weak_map_t *map, void *key) {
+    if (map->count == 0) {
+        return NULL;
+    }
+    size_t i = hash_pointer(key, map->capacity);
+    while (map->entries[i].key != NULL) {
+        if (map->entries[i].key == key) {
+            return &map->entries[i];
+        }
+        i = (i + 1) & (map->capacity - 1);
+    }
+    return NULL;
+}
+
+bool gc_weak_map_get(const gc_weak_map_t *map, void *key, uint64_t *value) {
+    gc_weak_entry_t *entry = weak_map_find(map, key);
+    if (entry == NULL) {
+        return false;
+    }
+    *value = entry->value;
+    return true;
+}
+
+// backward shift deletion keeps linear probing chains intact without tombstones
+static void weak_map_erase(gc_weak_map_t *map, size_t hole) {
+    size_t mask = map->capacity - 1;
+    size_t i = hole;
+    for (;;) {
+        i = (i + 1) & mask;
+        if (map->entries[i].key == NULL) {
+            break;
+        }
+        size_t home = hash_pointer(map->entries[i].key, map->capacity);
+        // entry may move into the hole if its home is not in (hole, i]
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            map->entries[hole] = map->entries[i];
+            hole = i;
+        }
+    }
+    map->entries[hole].key = NULL;
+    map->count -= 1;
+}
+
+bool gc_weak_map_remove(gc_weak_map_t *map, void *key) {
+    gc_weak_entry_t *entry = weak_map_find(map, key);
+    if (entry == NULL) {
+        return false;
+    }
+    weak_map_erase(map, entry - map->entries);
+    return true;
+}
+
+void gc_weak_map_moved(gc_weak_map_t *map, void *from, void *to) {
+    gc_weak_entry_t *entry = weak_map_find(map, from);
+    if (entry == NULL) {
+        return;
+    }
+    uint64_t value = entry->value;
+    weak_map_erase(map, entry - map->entries);
+    if (map->on_move == NULL || map->on_move(map, &value, from, to)) {
+        gc_weak_map_put(map, to, value);
+    }
+}
+
+void gc_weak_map_sweep(gc_weak_map_t *map, bool (*is_dead)(void *key)) {
+    size_t i = 0;
+    while (i < map->capacity) {
+        gc_weak_entry_t entry = map->entries[i];
+        if (entry.key != NULL && is_dead(entry.key)) {
+            // erase may shift the next entry into slot i, look at it again
+            weak_map_erase(map, i);
+            if (map->on_death != NULL) {
+                map->on_death(map, entry.value, entry.key);
+            }
+        } else {
+            i++;
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef STELLA_GC_WEAK_H
+#define STELLA_GC_WEAK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/** Maximum number of weak maps registered in one GC. */
+#define GC_MAX_WEAK_MAPS 8
+
+typedef struct gc_weak_entry_t {
+    void *key;
+    uint64_t value;
+} gc_weak_entry_t;
+
+/** Hash map from Stella objects to values which does not keep its keys alive.
+ * When a key is copied by the collector the entry is re-keyed to the new address,
+ * when a key dies the entry is dropped at the next flip.
+ */
+typedef struct gc_weak_map_t {
+    gc_weak_entry_t *entries;
+    size_t capacity;
+    size_t count;
+
+    /** Called after a key has been copied. Returning false drops the entry. May be NULL. */
+    bool (*on_move)(struct gc_weak_map_t *map, uint64_t *value, void *from, void *to);
+    /** Called for every entry whose key did not survive a collection. May be NULL. */
+    void (*on_death)(struct gc_weak_map_t *map, uint64_t value, void *key);
+    void *data;
+} gc_weak_map_t;
+
+void gc_weak_map_init(gc_weak_map_t *map,
+                      bool (*on_move)(gc_weak_map_t *, uint64_t *, void *, void *),
+                      void (*on_death)(gc_weak_map_t *, uint64_t, void *),
+                      void *data);
+
+void gc_weak_map_free(gc_weak_map_t *map);
+
+void gc_weak_map_put(gc_weak_map_t *map, void *key, uint64_t value);
+
+bool gc_weak_map_get(const gc_weak_map_t *map, void *key, uint64_t *value);
+
+bool gc_weak_map_remove(gc_weak_map_t *map, void *key);
+
+/** Re-key the entry for from (if any) to to, calling on_move. */
+void gc_weak_map_moved(gc_weak_map_t *map, void *from, void *to);
+
+/** Drop (and report through on_death) every entry whose key is_dead. */
+void gc_weak_map_sweep(gc_weak_map_t *map, bool (*is_dead)(void *key));
+
+/** Register a weak map with the GC. */
+void gc_register_weak_map(gc_weak_map_t *map);
+
+void gc_unregister_weak_map(gc_weak_map_t *map);
+
+/** Put object into a registered weak map, marking the object so that the collector
+ * keeps the map up to date when it copies the object.
+ */
+void gc_weak_put(gc_weak_map_t *map, void *object, uint64_t value);
+
+#endif
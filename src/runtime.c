@@ -1,10 +1,16 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
 
 #include "runtime.h"
 #include "gc.h"
+#include "gc_profile.h"
 
-int total_allocated_fields = 0;
+_Thread_local int total_allocated_fields = 0;
 
 stella_object the_ZERO = { .object_header = TAG_ZERO, .object_fields = {} } ;
 stella_object the_UNIT = { .object_header = TAG_UNIT, .object_fields = {} } ;
@@ -16,6 +22,10 @@ const int FIELD_COUNT_MASK = (1 << 8) - (1 << 4) ;
 const int TAG_MASK         = (1 << 4) - (1 << 0) ;
 
 stella_object* alloc_stella_object(enum TAG tag, int fields_count) {
+  return alloc_stella_object_at_site(tag, fields_count, 0);
+}
+
+stella_object* alloc_stella_object_at_site(enum TAG tag, int fields_count, int site) {
   stella_object *obj;
   total_allocated_fields += fields_count;
   switch (tag) {
@@ -28,35 +38,237 @@ stella_object* alloc_stella_object(enum TAG tag, int fields_count) {
     case TAG_TUPLE: if (fields_count == 0) { return &the_EMPTY_TUPLE; }
     // allocate an object with at least one field (or an unknown tag)
     default:
-      obj = gc_alloc((1 + fields_count) * sizeof(void*));
+      obj = gc_alloc_at_site((1 + fields_count) * sizeof(void*), site);
       STELLA_OBJECT_INIT_TAG(obj, tag);
       STELLA_OBJECT_INIT_FIELDS_COUNT(obj, fields_count);
+      gc_object_allocated(obj);
       return obj;
   }
 }
 
-stella_object *nat_to_stella_object(int n) {
-  stella_object *result, *x;
-  gc_push_root((void*)&result);    // it is sufficient to push only result
-  result = &the_ZERO;
-  for (int i = n; i > 0; i--) {
-    x = alloc_stella_object(TAG_SUCC, 1);
+static stella_object *bulk_object(stella_object *first, size_t stride, int i) {
+  return (stella_object *)((char *)first + i * stride);
+}
+
+stella_object *stella_succ_chain(int n, stella_object *base, int site) {
+  if (n <= 0) {
+    return base;
+  }
+  gc_push_root((void*)&base);
+  stella_object *first = gc_alloc_bulk(2 * sizeof(void*), n, site);
+  gc_pop_root((void*)&base);
+  const size_t stride = gc_bulk_stride(2 * sizeof(void*));
+  total_allocated_fields += n;
+  // the outermost succ comes first, so that reading the number walks forward through memory
+  stella_object *result = base;
+  for (int i = n - 1; i >= 0; i--) {
+    stella_object *x = bulk_object(first, stride, i);
+    STELLA_OBJECT_INIT_TAG(x, TAG_SUCC);
     STELLA_OBJECT_INIT_FIELD(x, 0, result);
-    result = x;
+    gc_object_allocated(x);
+    result = STELLA_OBJECT_INTERN(x);
+  }
+  return result;
+}
+
+stella_object *stella_list_from_array(stella_object **items, int count, int site) {
+  if (count <= 0) {
+    return &the_EMPTY;
+  }
+  for (int i = 0; i < count; i++) {
+    gc_push_root((void*)&items[i]);
+  }
+  stella_object *first = gc_alloc_bulk(3 * sizeof(void*), count, site);
+  for (int i = count - 1; i >= 0; i--) {
+    gc_pop_root((void*)&items[i]);
+  }
+  const size_t stride = gc_bulk_stride(3 * sizeof(void*));
+  total_allocated_fields += 2 * count;
+  // cells in list order, the last one ends the list
+  stella_object *result = &the_EMPTY;
+  for (int i = count - 1; i >= 0; i--) {
+    stella_object *cell = bulk_object(first, stride, i);
+    STELLA_OBJECT_INIT_TAG(cell, TAG_CONS);
+    STELLA_OBJECT_INIT_FIELD(cell, 0, items[i]);
+    STELLA_OBJECT_INIT_FIELD(cell, 1, result);
+    gc_object_allocated(cell);
+    result = STELLA_OBJECT_INTERN(cell);
   }
-  gc_pop_root((void*)&result);
   return result;
 }
 
+stella_object *nat_to_stella_object(int n) {
+  return stella_succ_chain(n, &the_ZERO, GC_SITE_RUNTIME_NAT);
+}
+
+static void nat_overflow(int bits) {
+  printf("Nat overflow: the result does not fit into %d bits\n", bits);
+  exit(1);
+}
+
 int stella_object_to_nat(stella_object* obj) {
   int result = 0;
   while (STELLA_OBJECT_HEADER_TAG(obj->object_header) == TAG_SUCC) {
     obj = STELLA_OBJECT_SUCC_ARG(obj);
     result += 1;
   }
+  if (STELLA_OBJECT_HEADER_TAG(obj->object_header) == TAG_NAT) {
+    const uint64_t low = (uintptr_t)obj->object_fields[0];
+    // a binary natural has no leading zero limbs
+    if (STELLA_OBJECT_HEADER_FIELD_COUNT(obj->object_header) != 1 || low > (uint64_t)(INT_MAX - result)) {
+      nat_overflow(sizeof(int) * 8 - 1);
+    }
+    result += (int)low;
+  }
   return result;
 }
 
+/** A natural number being computed on, limbs are little-endian and limbs[count - 1] is not 0. */
+typedef struct {
+  uint64_t limbs[STELLA_NAT_MAX_LIMBS];
+  int count;
+} nat_value;
+
+static void nat_add_word(nat_value *v, uint64_t word) {
+  for (int i = 0; word != 0; i++) {
+    if (i == v->count) {
+      if (i == STELLA_NAT_MAX_LIMBS) {
+        nat_overflow(STELLA_NAT_MAX_LIMBS * 64);
+      }
+      v->limbs[v->count++] = 0;
+    }
+    v->limbs[i] += word;
+    word = v->limbs[i] < word;
+  }
+}
+
+// a succ chain, possibly ending in a binary natural, read into a value without allocating
+static void nat_read(stella_object *n, nat_value *v) {
+  uint64_t succs = 0;
+  v->count = 0;
+  while (STELLA_OBJECT_HEADER_TAG(n->object_header) == TAG_SUCC) {
+    // the read barrier only counts the program's reads, the runtime's own walks are left out
+    n = n->object_fields[0];
+    succs += 1;
+  }
+  if (STELLA_OBJECT_HEADER_TAG(n->object_header) == TAG_NAT) {
+    v->count = STELLA_OBJECT_HEADER_FIELD_COUNT(n->object_header);
+    memcpy(v->limbs, n->object_fields, v->count * sizeof(uint64_t));
+  }
+  nat_add_word(v, succs);
+}
+
+static stella_object *nat_box(const nat_value *v) {
+  if (v->count == 0) {
+    return &the_ZERO;
+  }
+  stella_object *n = alloc_stella_object(TAG_NAT, v->count);
+  // raw limbs, neither barriers nor the collector look at them
+  memcpy(n->object_fields, v->limbs, v->count * sizeof(uint64_t));
+  return n;
+}
+
+static int nat_compare_values(const nat_value *a, const nat_value *b) {
+  if (a->count != b->count) {
+    return a->count < b->count ? -1 : 1;
+  }
+  for (int i = a->count - 1; i >= 0; i--) {
+    if (a->limbs[i] != b->limbs[i]) {
+      return a->limbs[i] < b->limbs[i] ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+stella_object *stella_nat_add(stella_object *a, stella_object *b) {
+  nat_value x, y;
+  nat_read(a, &x);
+  nat_read(b, &y);
+  uint64_t carry = 0;
+  for (int i = 0; i < y.count || carry != 0; i++) {
+    if (i == x.count) {
+      if (i == STELLA_NAT_MAX_LIMBS) {
+        nat_overflow(STELLA_NAT_MAX_LIMBS * 64);
+      }
+      x.limbs[x.count++] = 0;
+    }
+    unsigned __int128 sum = (unsigned __int128)x.limbs[i] + (i < y.count ? y.limbs[i] : 0) + carry;
+    x.limbs[i] = (uint64_t)sum;
+    carry = (uint64_t)(sum >> 64);
+  }
+  return nat_box(&x);
+}
+
+stella_object *stella_nat_mul(stella_object *a, stella_object *b) {
+  nat_value x, y, product;
+  nat_read(a, &x);
+  nat_read(b, &y);
+  if (x.count == 0 || y.count == 0) {
+    return &the_ZERO;
+  }
+  if (x.count + y.count - 1 > STELLA_NAT_MAX_LIMBS) {
+    nat_overflow(STELLA_NAT_MAX_LIMBS * 64);
+  }
+  uint64_t limbs[2 * STELLA_NAT_MAX_LIMBS] = {0};
+  for (int i = 0; i < x.count; i++) {
+    uint64_t carry = 0;
+    for (int j = 0; j < y.count; j++) {
+      unsigned __int128 t = (unsigned __int128)x.limbs[i] * y.limbs[j] + limbs[i + j] + carry;
+      limbs[i + j] = (uint64_t)t;
+      carry = (uint64_t)(t >> 64);
+    }
+    limbs[i + y.count] = carry;
+  }
+  product.count = x.count + y.count;
+  while (product.count > 0 && limbs[product.count - 1] == 0) {
+    product.count -= 1;
+  }
+  if (product.count > STELLA_NAT_MAX_LIMBS) {
+    nat_overflow(STELLA_NAT_MAX_LIMBS * 64);
+  }
+  memcpy(product.limbs, limbs, product.count * sizeof(uint64_t));
+  return nat_box(&product);
+}
+
+stella_object *stella_nat_pred(stella_object *n) {
+  switch (STELLA_OBJECT_HEADER_TAG(n->object_header)) {
+    case TAG_SUCC:
+      return STELLA_OBJECT_SUCC_ARG(n);
+    case TAG_NAT: {
+      nat_value v;
+      nat_read(n, &v);
+      for (int i = 0; v.limbs[i]-- == 0; i++) {
+      }
+      if (v.limbs[v.count - 1] == 0) {
+        v.count -= 1;
+      }
+      return nat_box(&v);
+    }
+    default:
+      return &the_ZERO;
+  }
+}
+
+stella_object *stella_nat_is_zero(stella_object *n) {
+  // binary naturals are never 0, zero is always the_ZERO
+  return STELLA_OBJECT_HEADER_TAG(n->object_header) == TAG_ZERO ? &the_TRUE : &the_FALSE;
+}
+
+int stella_nat_compare(stella_object *a, stella_object *b) {
+  nat_value x, y;
+  nat_read(a, &x);
+  nat_read(b, &y);
+  return nat_compare_values(&x, &y);
+}
+
+stella_object *stella_nat_equal(stella_object *a, stella_object *b) {
+  return stella_nat_compare(a, b) == 0 ? &the_TRUE : &the_FALSE;
+}
+
+stella_object *stella_nat_less(stella_object *a, stella_object *b) {
+  return stella_nat_compare(a, b) < 0 ? &the_TRUE : &the_FALSE;
+}
+
 stella_object* stella_object_nat_rec(stella_object* n, stella_object* z, stella_object* f) {
   stella_object *g;
 #ifdef STELLA_DEBUG
@@ -69,8 +281,8 @@ stella_object* stella_object_nat_rec(stella_object* n, stella_object* z, stella_
   gc_push_root(&n);
   gc_push_root(&z);
   gc_push_root(&f);
-  while (STELLA_OBJECT_HEADER_TAG(n->object_header) == TAG_SUCC) {
-    n = STELLA_OBJECT_SUCC_ARG(n);
+  while (STELLA_OBJECT_HEADER_TAG(n->object_header) != TAG_ZERO) {
+    n = stella_nat_pred(n);
     g = STELLA_OBJECT_CLOSURE_CALL(f, n);
     z = STELLA_OBJECT_CLOSURE_CALL(g, z);
   }
@@ -80,64 +292,209 @@ stella_object* stella_object_nat_rec(stella_object* n, stella_object* z, stella_
   return z;
 }
 
-void print_stella_object(stella_object* obj) {
-  // printf("[%d]", STELLA_OBJECT_HEADER_TAG(obj->object_header));
-  int fields_count = STELLA_OBJECT_HEADER_FIELD_COUNT(obj->object_header);
-  switch (STELLA_OBJECT_HEADER_TAG(obj->object_header)) {
-    case TAG_ZERO:
-      printf("0");
-      return;
-    case TAG_SUCC:
-      printf("%d", stella_object_to_nat(obj));
-      return;
-    case TAG_FALSE:
-      printf("false");
-      return;
-    case TAG_TRUE:
-      printf("true");
-      return;
-    case TAG_FN:
-      printf("fn<%p>", STELLA_OBJECT_READ_FIELD(obj, 0));
-      return;
-    case TAG_REF:
-      printf("ref<%p>", STELLA_OBJECT_READ_FIELD(obj, 0));
-      return;
-    case TAG_UNIT:
-      printf("unit");
-      return;
-    case TAG_INL:
-      printf("inl(");
-      print_stella_object(STELLA_OBJECT_READ_FIELD(obj, 0));
-      printf(")");
-      return;
-    case TAG_INR:
-      printf("inr(");
-      print_stella_object(STELLA_OBJECT_READ_FIELD(obj, 0));
-      printf(")");
-      return;
-    case TAG_EMPTY:
-      printf("[]");
-      return;
-    case TAG_CONS:
-      printf("[");
-      print_stella_object(STELLA_OBJECT_READ_FIELD(obj, 0));
-      obj = STELLA_OBJECT_READ_FIELD(obj, 1);
-      while (STELLA_OBJECT_HEADER_TAG(obj->object_header) == TAG_CONS) {
-        printf(", ");
-        print_stella_object(STELLA_OBJECT_READ_FIELD(obj, 0));
-        obj = STELLA_OBJECT_READ_FIELD(obj, 1);
+/** Output of the printer, flushed to a stream or to a file descriptor when full. */
+typedef struct {
+  FILE *file;
+  int fd;
+  size_t used;
+  char buffer[STELLA_PRINT_BUFFER_SIZE];
+} printer;
+
+/** A value being printed: the object and how many of its parts are printed already. */
+typedef struct {
+  stella_object *obj;
+  int index;
+} printer_frame;
+
+static void printer_flush(printer *out) {
+  if (out->file != NULL) {
+    fwrite(out->buffer, 1, out->used, out->file);
+  } else {
+    for (size_t written = 0; written < out->used; ) {
+      ssize_t n = write(out->fd, out->buffer + written, out->used - written);
+      if (n < 0 && errno != EINTR) {
+        break;
+      }
+      written += n > 0 ? n : 0;
+    }
+  }
+  out->used = 0;
+}
+
+static void printer_emit(printer *out, const char *text, size_t length) {
+  if (out->used + length > STELLA_PRINT_BUFFER_SIZE) {
+    printer_flush(out);
+  }
+  memcpy(out->buffer + out->used, text, length);
+  out->used += length;
+}
+
+#define PRINTER_EMIT(out, literal) printer_emit(out, literal, sizeof(literal) - 1)
+
+static void printer_emit_pointer(printer *out, const char *kind, void *address) {
+  char text[64];
+  int length = snprintf(text, sizeof(text), "%s<%p>", kind, address);
+  printer_emit(out, text, length);
+}
+
+// decimal digits, 18 at a time from the lowest
+static void printer_emit_nat(printer *out, stella_object *n) {
+  nat_value v;
+  nat_read(n, &v);
+  uint64_t chunks[STELLA_NAT_MAX_LIMBS * 64 / 59 + 1];
+  int chunks_count = 0;
+  do {
+    unsigned __int128 rest = 0;
+    for (int i = v.count - 1; i >= 0; i--) {
+      unsigned __int128 t = rest << 64 | v.limbs[i];
+      v.limbs[i] = (uint64_t)(t / 1000000000000000000ull);
+      rest = t % 1000000000000000000ull;
+    }
+    while (v.count > 0 && v.limbs[v.count - 1] == 0) {
+      v.count -= 1;
+    }
+    chunks[chunks_count++] = (uint64_t)rest;
+  } while (v.count > 0);
+  char text[sizeof(chunks) / sizeof(chunks[0]) * 18];
+  char *end = text + sizeof(text), *p = end;
+  for (int i = 0; i < chunks_count; i++) {
+    uint64_t chunk = chunks[i];
+    // inner chunks are padded with zeros to 18 digits, the highest one is not
+    for (int digits = 0; digits < 18 && (chunk != 0 || i < chunks_count - 1 || p == end); digits++) {
+      *--p = (char)('0' + chunk % 10);
+      chunk /= 10;
+    }
+  }
+  printer_emit(out, p, end - p);
+}
+
+// fields are read directly, as in nat_read
+static void print_to(printer *out, stella_object *root) {
+  printer_frame initial[64];
+  printer_frame *stack = initial;
+  int capacity = 64, depth = 0;
+  stack[depth++] = (printer_frame){root, 0};
+  while (depth > 0) {
+    printer_frame *top = &stack[depth - 1];
+    stella_object *obj = top->obj, *next = NULL;
+    switch (STELLA_OBJECT_HEADER_TAG(obj->object_header)) {
+      case TAG_ZERO:
+        PRINTER_EMIT(out, "0");
+        break;
+      case TAG_SUCC:
+      case TAG_NAT:
+        printer_emit_nat(out, obj);
+        break;
+      case TAG_FALSE:
+        PRINTER_EMIT(out, "false");
+        break;
+      case TAG_TRUE:
+        PRINTER_EMIT(out, "true");
+        break;
+      case TAG_FN:
+        printer_emit_pointer(out, "fn", obj->object_fields[0]);
+        break;
+      case TAG_REF:
+        // the contents are not followed, so cycles through references cannot loop the printer
+        printer_emit_pointer(out, "ref", obj->object_fields[0]);
+        break;
+      case TAG_UNIT:
+        PRINTER_EMIT(out, "unit");
+        break;
+      case TAG_INL:
+      case TAG_INR:
+        if (top->index == 0) {
+          if (STELLA_OBJECT_HEADER_TAG(obj->object_header) == TAG_INL) {
+            PRINTER_EMIT(out, "inl(");
+          } else {
+            PRINTER_EMIT(out, "inr(");
+          }
+          next = obj->object_fields[0];
+        } else {
+          PRINTER_EMIT(out, ")");
+        }
+        break;
+      case TAG_EMPTY:
+        PRINTER_EMIT(out, "[]");
+        break;
+      case TAG_CONS:
+        // the frame moves along the list, so a list takes one frame whatever its length
+        if (top->index == 0) {
+          PRINTER_EMIT(out, "[");
+          next = obj->object_fields[0];
+        } else if (STELLA_OBJECT_HEADER_TAG(((stella_object *)obj->object_fields[1])->object_header) == TAG_CONS) {
+          PRINTER_EMIT(out, ", ");
+          top->obj = obj->object_fields[1];
+          next = top->obj->object_fields[0];
+        } else {
+          PRINTER_EMIT(out, "]");
+        }
+        break;
+      case TAG_TUPLE: {
+        const int fields_count = STELLA_OBJECT_HEADER_FIELD_COUNT(obj->object_header);
+        if (top->index == 0) {
+          PRINTER_EMIT(out, "{");
+        }
+        if (top->index < fields_count) {
+          if (top->index > 0) {
+            PRINTER_EMIT(out, ", ");
+          }
+          next = obj->object_fields[top->index];
+        } else {
+          PRINTER_EMIT(out, "}");  // TODO: pretty print a tuple
+        }
+        break;
+      }
+    }
+    if (next == NULL) {
+      depth -= 1;
+      continue;
+    }
+    top->index += 1;
+    if (depth == capacity) {
+      printer_frame *grown = malloc(2 * capacity * sizeof(printer_frame));
+      if (grown == NULL) {
+        printf("Memory allocation for the printer stack failed!\n");
+        exit(1);
       }
-      printf("]");
-      return;
-    case TAG_TUPLE:
-      printf("{");
-      for (int i = 0; i < fields_count; i++) {
-        print_stella_object(obj->object_fields[i]);
-        if (i < fields_count - 1) { printf(", "); }
+      memcpy(grown, stack, depth * sizeof(printer_frame));
+      if (stack != initial) {
+        free(stack);
       }
-      printf("}");  // TODO: pretty print a tuple
-      return;
+      stack = grown;
+      capacity *= 2;
+    }
+    stack[depth++] = (printer_frame){next, 0};
   }
+  if (stack != initial) {
+    free(stack);
+  }
+  printer_flush(out);
+}
+
+static void print_with(FILE *file, int fd, stella_object *obj) {
+  printer *out = malloc(sizeof(printer));
+  if (out == NULL) {
+    printf("Memory allocation for the printer failed!\n");
+    exit(1);
+  }
+  out->file = file;
+  out->fd = fd;
+  out->used = 0;
+  print_to(out, obj);
+  free(out);
+}
+
+void fprint_stella_object(FILE *file, stella_object *obj) {
+  print_with(file, -1, obj);
+}
+
+void write_stella_object(int fd, stella_object *obj) {
+  print_with(NULL, fd, obj);
+}
+
+void print_stella_object(stella_object* obj) {
+  fprint_stella_object(stdout, obj);
 }
 
 void print_stella_stats() {
@@ -145,6 +502,10 @@ void print_stella_stats() {
   printf("\n------------------------------------------------------------\n");
   printf("Garbage collector (GC) statistics:\n");
   print_gc_alloc_stats();
+  printf("\nAllocation and survival by tag:\n");
+  print_gc_tag_profile();
+  printf("\nAllocation and survival by site:\n");
+  print_gc_site_stats();
   #endif
   #ifdef STELLA_RUNTIME_STATS
   printf("\n------------------------------------------------------------\n");
@@ -3,6 +3,8 @@
 
 #include <stdio.h>
 #include "gc.h"
+#include "gc_intern.h"
+#include "gc_pretenure.h"
 
 /** A Stella object with statically unknown number of fields.
  */
@@ -25,6 +27,9 @@ typedef struct {
 /** Extract the fields count from Stella object's header. */
 #define STELLA_OBJECT_HEADER_FIELD_COUNT(header) ((header & FIELD_COUNT_MASK) >> 4)
 
+/** Number of fields which hold Stella objects, the fields of TAG_NAT objects are raw limbs. */
+#define STELLA_OBJECT_HEADER_POINTER_COUNT(header) (STELLA_OBJECT_HEADER_TAG(header) == TAG_NAT ? 0 : STELLA_OBJECT_HEADER_FIELD_COUNT(header))
+
 /** Extract the n from succ(n). */
 #define STELLA_OBJECT_SUCC_ARG(obj) STELLA_OBJECT_READ_FIELD(obj,0)
 
@@ -33,7 +38,10 @@ typedef struct {
 /** Initialize new Stella object's fields count. */
 #define STELLA_OBJECT_INIT_FIELDS_COUNT(obj, count) (obj->object_header = ((obj->object_header >> 8) << 8) | STELLA_OBJECT_HEADER_TAG(obj->object_header) | count << 4)
 /** Initialize new Stella object's field. */
-#define STELLA_OBJECT_INIT_FIELD(obj, i, x) (obj->object_fields[i] = (void*)x)
+#define STELLA_OBJECT_INIT_FIELD(obj, i, x) GC_INIT_BARRIER(obj, i, (obj->object_fields[i] = (void*)x))
+
+/** Replace a freshly initialised immutable object with an equal hash-consed one (see gc_intern.h). */
+#define STELLA_OBJECT_INTERN(obj) ((stella_object *)gc_intern(obj))
 
 /** Call a Stella function (closure) with a given Stella object as an argument. */
 #define STELLA_OBJECT_CLOSURE_CALL(f, x) (*(stella_object *(*)(stella_object *, stella_object *))STELLA_OBJECT_READ_FIELD(f, 0))(f, x)
@@ -61,20 +69,55 @@ enum TAG {
   TAG_INL,    /**< inl(...) */
   TAG_INR,    /**< inr(...) */
   TAG_EMPTY,  /**< [] */
-  TAG_CONS    /**< cons(..., ...) */
+  TAG_CONS,   /**< cons(..., ...) */
+  TAG_NAT     /**< a natural number in binary, its fields are 64-bit limbs (see stella_nat_add) */
   } ;
 
 /** Allocate a new Stella object with a given TAG and number of fields.
  * Note that this function makes use of gc_alloc.
  */
 stella_object* alloc_stella_object(enum TAG tag, int fields_count);
+/** Same as alloc_stella_object, for an object allocated at a given site (see gc_pretenure.h). */
+stella_object* alloc_stella_object_at_site(enum TAG tag, int fields_count, int site);
+
+/** succ applied n times to base, built in one bulk reservation (see gc_alloc_bulk). */
+stella_object *stella_succ_chain(int n, stella_object *base, int site);
+/** A list of count items, its cells built in one bulk reservation in list order. */
+stella_object *stella_list_from_array(stella_object **items, int count, int site);
+
+/** Largest binary natural: 15 limbs of 64 bits (the fields count is 4 bits wide). */
+#define STELLA_NAT_MAX_LIMBS 15
+
+/** Natural number builtins. Arguments may be the_ZERO, succ chains or binary naturals (TAG_NAT),
+ * also mixed (succ over a binary natural); results are the_ZERO or a binary natural, so that
+ * every operation allocates at most one object. A result over STELLA_NAT_MAX_LIMBS limbs
+ * stops the program. Compiled code which uses them must match on Nat with stella_nat_is_zero
+ * and stella_nat_pred instead of reading succ fields.
+ */
+stella_object *stella_nat_add(stella_object *a, stella_object *b);
+stella_object *stella_nat_mul(stella_object *a, stella_object *b);
+/** n - 1, 0 for 0; the argument of a succ is returned as it is. */
+stella_object *stella_nat_pred(stella_object *n);
+/** Stella Bool: n == 0. */
+stella_object *stella_nat_is_zero(stella_object *n);
+stella_object *stella_nat_equal(stella_object *a, stella_object *b);
+stella_object *stella_nat_less(stella_object *a, stella_object *b);
+/** -1, 0 or 1 as a is less than, equal to or greater than b. */
+int stella_nat_compare(stella_object *a, stella_object *b);
 
 /** Convert a natural number (non-negative integer) into a corresponding Stella object. */
 stella_object *nat_to_stella_object(int n);
-/** Convert a natural number represented as a Stella object to an integer. */
+/** Convert a natural number represented as a Stella object to an integer, stops if it exceeds INT_MAX. */
 int stella_object_to_nat(stella_object* obj);
-/** Pretty-print a Stella object. */
+/** Size of the printer's output buffer, output is written out in pieces of this size. */
+#define STELLA_PRINT_BUFFER_SIZE (64 * 1024)
+
+/** Pretty-print a Stella object to stdout. */
 void print_stella_object(stella_object* obj);
+/** Pretty-print a Stella object to a stream; the stream is not flushed. */
+void fprint_stella_object(FILE *file, stella_object *obj);
+/** Pretty-print a Stella object to a file descriptor, past any stdio buffering of it. */
+void write_stella_object(int fd, stella_object *obj);
 /** Print some Stella runtime statistics. */
 void print_stella_stats();
 
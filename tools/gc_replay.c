@@ -0,0 +1,135 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "runtime.h"
+#include "gc_record.h"
+#include "gc_weak.h"
+
+// gc-replay: feed a trace recorded with STELLA_GC_RECORD=<file> back through the GC API
+// usage: gc-replay <trace>
+//
+// Objects are replayed with their recorded tags and shapes, non-heap values
+// (static objects, function pointers) are replaced by the_UNIT.
+
+#define MAX_REPLAY_ROOTS (1 << 16)
+
+static stella_object **objects = NULL;   // id -> current address, NULL once dead
+static size_t objects_capacity = 0;
+static gc_weak_map_t replay_ids;        // current address -> id
+static stella_object *roots[MAX_REPLAY_ROOTS];
+static size_t roots_depth = 0;
+
+static bool on_move(gc_weak_map_t *map, uint64_t *id, void *from, void *to) {
+    objects[*id] = to;
+    return true;
+}
+
+static void on_death(gc_weak_map_t *map, uint64_t id, void *object) {
+    objects[id] = NULL;
+}
+
+static stella_object *resolve(uint64_t id) {
+    if (id == 0 || id >= objects_capacity || objects[id] == NULL) {
+        return &the_UNIT;
+    }
+    return objects[id];
+}
+
+static void remember(uint64_t id, stella_object *object) {
+    if (id >= objects_capacity) {
+        size_t capacity = objects_capacity == 0 ? 1024 : objects_capacity;
+        while (capacity <= id) {
+            capacity *= 2;
+        }
+        objects = realloc(objects, capacity * sizeof(stella_object *));
+        if (objects == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+        memset(objects + objects_capacity, 0, (capacity - objects_capacity) * sizeof(stella_object *));
+        objects_capacity = capacity;
+    }
+    objects[id] = object;
+    gc_weak_put(&replay_ids, object, id);
+}
+
+static int field_count(stella_object *object) {
+    return STELLA_OBJECT_HEADER_FIELD_COUNT(object->object_header);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s <trace>\n", argv[0]);
+        return 1;
+    }
+    gc_record_reader_t reader;
+    if (!gc_record_reader_open(&reader, argv[1])) {
+        return 1;
+    }
+    gc_weak_map_init(&replay_ids, on_move, on_death, NULL);
+    gc_register_weak_map(&replay_ids);
+
+    uint64_t next_id = 1, events = 0;
+    uint64_t start_ns = gc_clock_ns();
+    gc_record_event_t event;
+    while (gc_record_reader_next(&reader, &event)) {
+        events++;
+        stella_object *object;
+        switch (event.op) {
+            case GC_RECORD_ALLOC:
+                object = alloc_stella_object(event.args[0], event.args[1]);
+                for (int i = 0; i < field_count(object); i++) {
+                    object->object_fields[i] = &the_UNIT;
+                }
+                remember(next_id++, object);
+                break;
+            case GC_RECORD_INIT:
+                object = resolve(event.args[0]);
+                if (event.args[1] < (uint64_t) field_count(object)) {
+                    object->object_fields[event.args[1]] = resolve(event.args[2]);
+                }
+                break;
+            case GC_RECORD_WRITE:
+                object = resolve(event.args[0]);
+                if (event.args[1] < (uint64_t) field_count(object)) {
+                    STELLA_OBJECT_WRITE_FIELD(object, event.args[1], resolve(event.args[2]));
+                }
+                break;
+            case GC_RECORD_READ:
+                object = resolve(event.args[0]);
+                if (event.args[1] < (uint64_t) field_count(object)) {
+                    (void) STELLA_OBJECT_READ_FIELD(object, event.args[1]);
+                }
+                break;
+            case GC_RECORD_PUSH_ROOT:
+                if (roots_depth == MAX_REPLAY_ROOTS) {
+                    printf("Too many roots in trace\n");
+                    return 1;
+                }
+                roots[roots_depth] = resolve(event.args[0]);
+                gc_push_root((void **) &roots[roots_depth++]);
+                break;
+            case GC_RECORD_POP_ROOT:
+                if (roots_depth > 0) {
+                    gc_pop_root((void **) &roots[--roots_depth]);
+                }
+                break;
+            case GC_RECORD_ROOT_SET:
+                if (event.args[0] < roots_depth) {
+                    roots[event.args[0]] = resolve(event.args[1]);
+                }
+                break;
+        }
+    }
+    uint64_t elapsed_ns = gc_clock_ns() - start_ns;
+    if (reader.position < reader.size) {
+        printf("Malformed event at offset %lu, replay stopped\n", (unsigned long) reader.position);
+    }
+    gc_record_reader_close(&reader);
+
+    printf("Replayed %lu events (%lu objects) in %.3f ms, %.1f Mevents/s\n", (unsigned long) events,
+           (unsigned long) (next_id - 1), elapsed_ns / 1e6, elapsed_ns > 0 ? events * 1e3 / elapsed_ns : 0.0);
+    print_gc_alloc_stats();
+    return 0;
+}
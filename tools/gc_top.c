@@ -0,0 +1,74 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "gc_shm.h"
+
+// gc-top: attach to a GC stats page published with STELLA_GC_SHM and print live rates
+// usage: gc-top <stats file> [interval ms]
+
+static gc_shm_page_t *attach(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    gc_shm_page_t *page = mmap(NULL, sizeof(gc_shm_page_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        return NULL;
+    }
+    if (page->magic != GC_SHM_MAGIC || page->version != GC_SHM_VERSION) {
+        munmap(page, sizeof(gc_shm_page_t));
+        return NULL;
+    }
+    return page;
+}
+
+static double per_second(uint64_t now, uint64_t before, uint64_t elapsed_ns) {
+    return elapsed_ns > 0 ? (double) (now - before) * 1e9 / (double) elapsed_ns : 0.0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s <stats file> [interval ms]\n", argv[0]);
+        return 1;
+    }
+    long interval_ms = argc > 2 ? atol(argv[2]) : 1000;
+    if (interval_ms <= 0) {
+        interval_ms = 1000;
+    }
+    gc_shm_page_t *page = attach(argv[1]);
+    if (page == NULL) {
+        printf("Failed to attach to GC stats page %s\n", argv[1]);
+        return 1;
+    }
+    printf("attached to pid %lld\n", (long long) page->pid);
+    printf("%10s %10s %10s %10s %10s %8s %8s %7s %10s\n",
+           "alloc MB/s", "objects/s", "live KB", "peak KB", "heap KB", "cycles", "phase", "gc %", "max pause");
+
+    gc_shm_sample_t previous, current;
+    gc_shm_read(page, &previous);
+    struct timespec delay = {.tv_sec = interval_ms / 1000, .tv_nsec = (interval_ms % 1000) * 1000000};
+    while (kill((pid_t) page->pid, 0) == 0) {
+        nanosleep(&delay, NULL);
+        gc_shm_read(page, &current);
+        uint64_t elapsed = current.timestamp_ns - previous.timestamp_ns;
+        double gc_share = elapsed > 0 ? 100.0 * (double) (current.total_gc_ns - previous.total_gc_ns) / (double) elapsed : 0.0;
+        printf("%10.2f %10.0f %10lu %10lu %10lu %8lu %8s %6.2f%% %8.3fms\n",
+               per_second(current.total_allocated_bytes, previous.total_allocated_bytes, elapsed) / (1024.0 * 1024.0),
+               per_second(current.total_allocated_objects, previous.total_allocated_objects, elapsed),
+               (unsigned long) (current.live_bytes / 1024), (unsigned long) (current.max_live_bytes / 1024),
+               (unsigned long) (current.heap_size / 1024), (unsigned long) current.mark_phase_count,
+               current.phase == 0 ? "mark" : "sweep", gc_share, current.max_pause_ns / 1e6);
+        fflush(stdout);
+        previous = current;
+    }
+    printf("process %lld exited\n", (long long) page->pid);
+    munmap(page, sizeof(gc_shm_page_t));
+    return 0;
+}
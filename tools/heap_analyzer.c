@@ -0,0 +1,352 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "gc_snapshot.h"
+#include "gc_profile.h"
+
+// gc-heap: offline analysis of a heap snapshot written by gc_dump_heap_snapshot
+// usage: gc-heap <snapshot> [top N]
+//
+// Builds the object graph with a virtual root pointing to every GC root, computes
+// the dominator tree (Cooper, Harvey, Kennedy "A Simple, Fast Dominance Algorithm")
+// and reports retained sizes.
+
+#define NO_NODE UINT32_MAX
+
+typedef struct heap_t {
+    size_t count;               // objects are nodes 1..count, node 0 is the virtual root
+    gc_snapshot_object_t *objects;
+    uint64_t *fields;
+    size_t *fields_start;
+
+    size_t roots_count;
+    uint64_t *roots;
+
+    // successors / predecessors in CSR form
+    size_t *succ_start;
+    uint32_t *succ;
+    size_t *pred_start;
+    uint32_t *pred;
+
+    uint32_t *postorder;        // nodes in DFS postorder
+    uint32_t *order;            // node -> postorder number, NO_NODE if unreachable
+    size_t reachable;
+    uint32_t *idom;
+    uint64_t *retained;
+} heap_t;
+
+static void *checked_malloc(size_t size) {
+    void *result = malloc(size > 0 ? size : 1);
+    if (result == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    return result;
+}
+
+static bool read_exact(FILE *in, void *buffer, size_t size) {
+    return fread(buffer, 1, size, in) == size;
+}
+
+static bool load_snapshot(const char *path, heap_t *heap) {
+    FILE *in = fopen(path, "rb");
+    if (in == NULL) {
+        printf("Failed to open heap snapshot %s\n", path);
+        return false;
+    }
+    gc_snapshot_header_t header;
+    if (!read_exact(in, &header, sizeof(header)) || memcmp(header.magic, GC_SNAPSHOT_MAGIC, 8) != 0
+        || header.version != GC_SNAPSHOT_VERSION) {
+        printf("%s is not a heap snapshot\n", path);
+        fclose(in);
+        return false;
+    }
+    heap->count = header.objects_count;
+    heap->objects = checked_malloc((heap->count + 1) * sizeof(gc_snapshot_object_t));
+    heap->fields_start = checked_malloc((heap->count + 2) * sizeof(size_t));
+    size_t fields_capacity = 1024, fields_count = 0;
+    heap->fields = checked_malloc(fields_capacity * sizeof(uint64_t));
+    memset(&heap->objects[0], 0, sizeof(gc_snapshot_object_t));
+    heap->fields_start[0] = heap->fields_start[1] = 0;
+    for (size_t i = 1; i <= heap->count; i++) {
+        gc_snapshot_object_t *object = &heap->objects[i];
+        if (!read_exact(in, object, sizeof(*object))) {
+            printf("Truncated heap snapshot\n");
+            fclose(in);
+            return false;
+        }
+        while (fields_count + object->field_count > fields_capacity) {
+            fields_capacity *= 2;
+            heap->fields = realloc(heap->fields, fields_capacity * sizeof(uint64_t));
+            if (heap->fields == NULL) {
+                printf("Memory allocation failed!\n");
+                exit(1);
+            }
+        }
+        if (!read_exact(in, &heap->fields[fields_count], object->field_count * sizeof(uint64_t))) {
+            printf("Truncated heap snapshot\n");
+            fclose(in);
+            return false;
+        }
+        fields_count += object->field_count;
+        heap->fields_start[i + 1] = fields_count;
+    }
+    heap->roots_count = header.roots_count;
+    heap->roots = checked_malloc(heap->roots_count * sizeof(uint64_t));
+    bool ok = read_exact(in, heap->roots, heap->roots_count * sizeof(uint64_t));
+    fclose(in);
+    if (!ok) {
+        printf("Truncated heap snapshot\n");
+    }
+    return ok;
+}
+
+// objects are written in address order by the linear heap walk
+static uint32_t find_object(const heap_t *heap, uint64_t address) {
+    size_t lo = 1, hi = heap->count + 1;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (heap->objects[mid].address < address) { lo = mid + 1; } else { hi = mid; }
+    }
+    if (lo <= heap->count && heap->objects[lo].address == address) {
+        return lo;
+    }
+    return NO_NODE;
+}
+
+static void build_graph(heap_t *heap) {
+    size_t nodes = heap->count + 1;
+    size_t *succ_count = calloc(nodes + 1, sizeof(size_t));
+    size_t *pred_count = calloc(nodes + 1, sizeof(size_t));
+    if (succ_count == NULL || pred_count == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    // two passes: count, then fill
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t r = 0; r < heap->roots_count; r++) {
+            uint32_t target = find_object(heap, heap->roots[r]);
+            if (target == NO_NODE) { continue; }
+            if (pass == 0) {
+                succ_count[0]++;
+                pred_count[target]++;
+            } else {
+                heap->succ[heap->succ_start[0] + succ_count[0]++] = target;
+                heap->pred[heap->pred_start[target] + pred_count[target]++] = 0;
+            }
+        }
+        for (size_t node = 1; node < nodes; node++) {
+            for (size_t f = heap->fields_start[node]; f < heap->fields_start[node + 1]; f++) {
+                uint32_t target = find_object(heap, heap->fields[f]);
+                if (target == NO_NODE) { continue; }
+                if (pass == 0) {
+                    succ_count[node]++;
+                    pred_count[target]++;
+                } else {
+                    heap->succ[heap->succ_start[node] + succ_count[node]++] = target;
+                    heap->pred[heap->pred_start[target] + pred_count[target]++] = node;
+                }
+            }
+        }
+        if (pass == 0) {
+            heap->succ_start = checked_malloc((nodes + 1) * sizeof(size_t));
+            heap->pred_start = checked_malloc((nodes + 1) * sizeof(size_t));
+            heap->succ_start[0] = heap->pred_start[0] = 0;
+            for (size_t node = 0; node < nodes; node++) {
+                heap->succ_start[node + 1] = heap->succ_start[node] + succ_count[node];
+                heap->pred_start[node + 1] = heap->pred_start[node] + pred_count[node];
+                succ_count[node] = pred_count[node] = 0;
+            }
+            heap->succ = checked_malloc(heap->succ_start[nodes] * sizeof(uint32_t));
+            heap->pred = checked_malloc(heap->pred_start[nodes] * sizeof(uint32_t));
+        }
+    }
+    free(succ_count);
+    free(pred_count);
+}
+
+// iterative DFS from the virtual root, deep lists would overflow a recursive one
+static void compute_postorder(heap_t *heap) {
+    size_t nodes = heap->count + 1;
+    heap->postorder = checked_malloc(nodes * sizeof(uint32_t));
+    heap->order = checked_malloc(nodes * sizeof(uint32_t));
+    uint32_t *stack = checked_malloc(nodes * sizeof(uint32_t));
+    size_t *next_edge = checked_malloc(nodes * sizeof(size_t));
+    bool *visited = calloc(nodes, sizeof(bool));
+    for (size_t i = 0; i < nodes; i++) {
+        heap->order[i] = NO_NODE;
+    }
+    size_t top = 0, count = 0;
+    stack[top++] = 0;
+    visited[0] = true;
+    next_edge[0] = heap->succ_start[0];
+    while (top > 0) {
+        uint32_t node = stack[top - 1];
+        if (next_edge[node] < heap->succ_start[node + 1]) {
+            uint32_t target = heap->succ[next_edge[node]++];
+            if (!visited[target]) {
+                visited[target] = true;
+                next_edge[target] = heap->succ_start[target];
+                stack[top++] = target;
+            }
+        } else {
+            heap->order[node] = count;
+            heap->postorder[count++] = node;
+            top--;
+        }
+    }
+    heap->reachable = count;
+    free(stack);
+    free(next_edge);
+    free(visited);
+}
+
+static uint32_t intersect(const heap_t *heap, uint32_t a, uint32_t b) {
+    while (a != b) {
+        while (heap->order[a] < heap->order[b]) { a = heap->idom[a]; }
+        while (heap->order[b] < heap->order[a]) { b = heap->idom[b]; }
+    }
+    return a;
+}
+
+static void compute_dominators(heap_t *heap) {
+    size_t nodes = heap->count + 1;
+    heap->idom = checked_malloc(nodes * sizeof(uint32_t));
+    for (size_t i = 0; i < nodes; i++) {
+        heap->idom[i] = NO_NODE;
+    }
+    heap->idom[0] = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        // reverse postorder, skipping the root (last in postorder)
+        for (size_t i = heap->reachable - 1; i-- > 0;) {
+            uint32_t node = heap->postorder[i];
+            uint32_t new_idom = NO_NODE;
+            for (size_t p = heap->pred_start[node]; p < heap->pred_start[node + 1]; p++) {
+                uint32_t pred = heap->pred[p];
+                if (heap->idom[pred] == NO_NODE) { continue; }
+                new_idom = new_idom == NO_NODE ? pred : intersect(heap, pred, new_idom);
+            }
+            if (heap->idom[node] != new_idom) {
+                heap->idom[node] = new_idom;
+                changed = true;
+            }
+        }
+    }
+    // a node is finished before its dominator, so postorder accumulates children first
+    heap->retained = calloc(nodes, sizeof(uint64_t));
+    for (size_t i = 0; i < heap->reachable; i++) {
+        uint32_t node = heap->postorder[i];
+        heap->retained[node] += heap->objects[node].size;
+        if (node != 0) {
+            heap->retained[heap->idom[node]] += heap->retained[node];
+        }
+    }
+}
+
+static const char *node_tag(const heap_t *heap, uint32_t node) {
+    return gc_tag_name(heap->objects[node].header & 0xf);
+}
+
+static const heap_t *sort_heap = NULL;
+
+static int compare_nodes_by_retained(const void *a, const void *b) {
+    uint64_t x = sort_heap->retained[*(const uint32_t *) a];
+    uint64_t y = sort_heap->retained[*(const uint32_t *) b];
+    return x < y ? 1 : (x > y ? -1 : 0);
+}
+
+static void print_report(const heap_t *heap, size_t top) {
+    uint64_t total_bytes = 0, reachable_bytes = 0;
+    uint64_t tag_objects[GC_PROFILE_TAGS] = {0}, tag_bytes[GC_PROFILE_TAGS] = {0};
+    for (size_t node = 1; node <= heap->count; node++) {
+        total_bytes += heap->objects[node].size;
+        if (heap->order[node] != NO_NODE) {
+            reachable_bytes += heap->objects[node].size;
+            tag_objects[heap->objects[node].header & 0xf] += 1;
+            tag_bytes[heap->objects[node].header & 0xf] += heap->objects[node].size;
+        }
+    }
+    printf("Objects in heap:        %lu (%lu bytes)\n", (unsigned long) heap->count, (unsigned long) total_bytes);
+    printf("Reachable from roots:   %lu (%lu bytes)\n", (unsigned long) heap->reachable - 1, (unsigned long) reachable_bytes);
+    printf("Garbage:                %lu (%lu bytes)\n", (unsigned long) (heap->count - heap->reachable + 1),
+           (unsigned long) (total_bytes - reachable_bytes));
+    printf("Roots:                  %lu\n\n", (unsigned long) heap->roots_count);
+
+    printf("Live objects by tag:\n");
+    for (int tag = 0; tag < GC_PROFILE_TAGS; tag++) {
+        if (tag_objects[tag] > 0) {
+            printf("  %-8s %10lu objects %12lu bytes\n", gc_tag_name(tag), (unsigned long) tag_objects[tag],
+                   (unsigned long) tag_bytes[tag]);
+        }
+    }
+
+    uint32_t *by_retained = checked_malloc(heap->reachable * sizeof(uint32_t));
+    size_t candidates = 0;
+    for (size_t i = 0; i < heap->reachable; i++) {
+        if (heap->postorder[i] != 0) {
+            by_retained[candidates++] = heap->postorder[i];
+        }
+    }
+    sort_heap = heap;
+    qsort(by_retained, candidates, sizeof(uint32_t), compare_nodes_by_retained);
+    printf("\nLargest retainers:\n");
+    printf("  %-18s %-8s %10s %14s %5s\n", "object", "tag", "size", "retained", "age");
+    for (size_t i = 0; i < candidates && i < top; i++) {
+        uint32_t node = by_retained[i];
+        printf("  0x%016lx %-8s %10u %14lu %5u\n", (unsigned long) heap->objects[node].address, node_tag(heap, node),
+               heap->objects[node].size, (unsigned long) heap->retained[node], heap->objects[node].age);
+    }
+
+    printf("\nRetained size per root:\n");
+    for (size_t r = 0; r < heap->roots_count; r++) {
+        uint32_t node = find_object(heap, heap->roots[r]);
+        if (node == NO_NODE) {
+            printf("  root %3lu: 0x%016lx (not in heap)\n", (unsigned long) r, (unsigned long) heap->roots[r]);
+            continue;
+        }
+        if (heap->idom[node] != 0) {
+            printf("  root %3lu: 0x%016lx %-8s shared, dominated by 0x%016lx\n", (unsigned long) r,
+                   (unsigned long) heap->roots[r], node_tag(heap, node),
+                   (unsigned long) heap->objects[heap->idom[node]].address);
+            continue;
+        }
+        printf("  root %3lu: 0x%016lx %-8s retains %lu bytes", (unsigned long) r, (unsigned long) heap->roots[r],
+               node_tag(heap, node), (unsigned long) heap->retained[node]);
+        // biggest object dominated directly by this root
+        uint32_t biggest = NO_NODE;
+        for (size_t i = 0; i < candidates; i++) {
+            if (heap->idom[by_retained[i]] == node) {
+                biggest = by_retained[i];
+                break;
+            }
+        }
+        if (biggest != NO_NODE) {
+            printf(", largest child 0x%016lx %s (%lu bytes)", (unsigned long) heap->objects[biggest].address,
+                   node_tag(heap, biggest), (unsigned long) heap->retained[biggest]);
+        }
+        printf("\n");
+    }
+    free(by_retained);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s <snapshot> [top N]\n", argv[0]);
+        return 1;
+    }
+    size_t top = argc > 2 && atol(argv[2]) > 0 ? atol(argv[2]) : 20;
+    heap_t heap;
+    memset(&heap, 0, sizeof(heap));
+    if (!load_snapshot(argv[1], &heap)) {
+        return 1;
+    }
+    build_graph(&heap);
+    compute_postorder(&heap);
+    compute_dominators(&heap);
+    print_report(&heap, top);
+    return 0;
+}